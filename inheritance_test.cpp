@@ -3,10 +3,10 @@
 
 int main()
 {
-    unsigned char * buffer[100];
-
     MultiUnitSmartData<1, 2, 3> multiUnitSmartData;
 
+    std::array<char, MultiUnitSmartData<1, 2, 3>::serialized_size()> buffer;
+
     multiUnitSmartData.setValue<1>(10);
     multiUnitSmartData.setValue<2>(20);
     multiUnitSmartData.setValue<3>(30);
@@ -22,7 +22,7 @@ int main()
     MultiUnitSmartData_element<2> multiUnitSmartData_element20;
     MultiUnitSmartData_element<3> multiUnitSmartData_element30;
 
-    multiUnitSmartData.serialize(reinterpret_cast<char *>(buffer));
+    multiUnitSmartData.serialize(buffer);
 
     std::cout << "multiUnitSmartData getElement<1>() = " << multiUnitSmartData.getElement<3>().a << std::endl;
     std::cout << "multiUnitSmartData getElement<2>() = " << multiUnitSmartData.getElement<1>().a << std::endl;
@@ -30,7 +30,7 @@ int main()
 
     //std::cout << "Test" << multiUnitSmartData.getValue<LISTV<1,2,3>::Get<2>()>() << std::endl;
 
-    multiUnitSmartData.deserialize(reinterpret_cast<char *>(buffer), multiUnitSmartData_element20, multiUnitSmartData_element10, multiUnitSmartData_element30);
+    multiUnitSmartData.deserialize(buffer, multiUnitSmartData_element20, multiUnitSmartData_element10, multiUnitSmartData_element30);
 
 
     std::cout << "multiUnitSmartData_element10.a = " << multiUnitSmartData_element10.a << std::endl;
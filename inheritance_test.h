@@ -2,7 +2,14 @@
 #pragma once
 
 #include "meta.h"
+#include "utility/endian.h"
+#include "utility/varint.h"
 #include <iostream>
+#include <cstddef>
+#include <array>
+#include <sys/uio.h>
+
+template<typename T, unsigned int N> class Array;
 
 class Test1{
 public:
@@ -41,13 +48,16 @@ public:
 typedef float Float32;
 typedef double Float64;
 typedef unsigned int UInt32;
+typedef long long Int64;
 
 
 template<UInt32 Unit>
 struct MultiUnitSmartData_element {
 public:
+    typedef int Value;
+
     unsigned int _unit = Unit*2;
-    int a;
+    Value a;
     //overload the << operator for the MultiUnitSmartData_element class
     //std::ostream operator << (std::ostream & os) {
     //    os << "MultiUnitSmartData_element<" << Unit << ">::_unit = " << _unit << std::endl;
@@ -59,18 +69,144 @@ public:
 template <UInt32... Units>
 struct MultiUnitSmartData : public LIST<MultiUnitSmartData_element<Units>...>::Recur{
 public:
-    //This takes a buffer and a list of values and serializes them into the buffer, the const Tn & ... an means that it can take both references to rvalues and lvalues
+    typedef SERIALIZER<MultiUnitSmartData_element<Units>...> Serializer;
+
+    // Number of bytes written by serialize() (i.e. the packed size of all elements)
+    static constexpr unsigned int serialized_size() { return Serializer::size(); }
+
+    //This takes a buffer and serializes all elements into it, each at an offset computed at compile time
+    // The caller must guarantee serialized_size() bytes; prefer the sized overloads below
     void serialize(char* buffer) {
-        // Force a compilation error in case out is called with too many arguments
-        //typename IF<(SIZEOF<Tn ...>::Result <= SIZEOF<Units ...>::Result(), int, void>::Result index = 0;
-        SERIALIZE(buffer, 0, getElement<Units>()...);
+        Serializer::serialize(buffer, getElement<Units>()...);
+    }
+
+    // Restores all elements from a buffer filled by serialize()
+    void deserialize(const char* buffer) {
+        Serializer::deserialize(buffer, getElement<Units>()...);
+    }
+
+    // Statically sized buffers: a buffer that is too small is a compilation error and the copies stay branch-free
+    template<typename T, std::size_t N>
+    void serialize(std::array<T, N> & buffer) {
+        static_assert(N * sizeof(T) >= serialized_size(), "Buffer is too small for this MultiUnitSmartData");
+        serialize(reinterpret_cast<char*>(buffer.data()));
+    }
+
+    template<typename T, std::size_t N>
+    void deserialize(const std::array<T, N> & buffer) {
+        static_assert(N * sizeof(T) >= serialized_size(), "Buffer is too small for this MultiUnitSmartData");
+        deserialize(reinterpret_cast<const char*>(buffer.data()));
+    }
+
+    template<typename T, unsigned int N>
+    void serialize(Array<T, N> & buffer) {
+        static_assert(N * sizeof(T) >= serialized_size(), "Buffer is too small for this MultiUnitSmartData");
+        serialize(reinterpret_cast<char*>(static_cast<T*>(buffer)));
+    }
+
+    template<typename T, unsigned int N>
+    void deserialize(const Array<T, N> & buffer) {
+        static_assert(N * sizeof(T) >= serialized_size(), "Buffer is too small for this MultiUnitSmartData");
+        deserialize(reinterpret_cast<const char*>(static_cast<const T*>(buffer)));
+    }
+
+    // Dynamically sized buffers (e.g. a span): a single capacity check, returning false (and touching nothing) if it fails
+    bool serialize(char* buffer, unsigned int size) {
+        if(size < serialized_size())
+            return false;
+        serialize(buffer);
+        return true;
+    }
+
+    bool deserialize(const char* buffer, unsigned int size) {
+        if(size < serialized_size())
+            return false;
+        deserialize(buffer);
+        return true;
     }
 
-    template<typename ... Tn>
-    void deserialize(char* buffer, Tn && ... an) {
-        // Force a compilation error in case out is called with too many arguments
-        //typename IF<(SIZEOF<Tn ...>::Result <= MAX_PARAMETERS_SIZE), int, void>::Result index = 0;
-        DESERIALIZE(buffer, 0, an ...);
+    // Scatter/gather: one iovec per element, pointing straight at its storage, so the record can go to writev()/sendmsg() without a copy
+    static const unsigned int IOVECS = sizeof...(Units);
+
+    unsigned int serialize(struct iovec* iov) {
+        int expand[] = { 0, (*iov++ = iovec{ &getElement<Units>(), sizeof(MultiUnitSmartData_element<Units>) }, 0) ... };
+        (void)expand;
+        return IOVECS;
+    }
+
+    // Gathers a record laid out as by serialize() from n (possibly fragmented) iovecs, returning false (and touching
+    // nothing) if they are too short
+    bool deserialize(const struct iovec* iov, unsigned int n) {
+        Gather gather(iov, n);
+        if(!gather.holds(serialized_size()))
+            return false;
+        int expand[] = { 0, (gather(&getElement<Units>(), sizeof(MultiUnitSmartData_element<Units>)), 0) ... };
+        (void)expand;
+        return true;
+    }
+
+    // Big-endian (network byte order) variants; elements are made of 32-bit words (_unit and a), swapped in a single batch
+    void serialize_big_endian(char* buffer) {
+        static_assert(serialized_size() % sizeof(UInt32) == 0, "MultiUnitSmartData_element is not made of 32-bit words");
+        serialize(buffer);
+        Endian::htobe<sizeof(UInt32)>(buffer, buffer, serialized_size() / sizeof(UInt32));
+    }
+
+    void deserialize_big_endian(const char* buffer) {
+        static_assert(serialized_size() % sizeof(UInt32) == 0, "MultiUnitSmartData_element is not made of 32-bit words");
+        char host[serialized_size()];
+        Endian::betoh<sizeof(UInt32)>(host, buffer, serialized_size() / sizeof(UInt32));
+        deserialize(host);
+    }
+
+    //This takes a buffer filled by serialize() and a list of elements in any order, and copies each element from the offset of its own Unit
+    // The caller must guarantee serialized_size() bytes; prefer the sized overloads below
+    template<UInt32 ... Un>
+    void deserialize(const char* buffer, MultiUnitSmartData_element<Un> & ... an) {
+        int expand[] = { 0, (__builtin_memcpy(&an, &buffer[Offset<MultiUnitSmartData_element<Un>>::Result], sizeof(MultiUnitSmartData_element<Un>)), 0) ... };
+        (void)expand;
+    }
+
+    template<typename T, std::size_t N, UInt32 ... Un>
+    void deserialize(const std::array<T, N> & buffer, MultiUnitSmartData_element<Un> & ... an) {
+        static_assert(N * sizeof(T) >= serialized_size(), "Buffer is too small for this MultiUnitSmartData");
+        deserialize(reinterpret_cast<const char*>(buffer.data()), an...);
+    }
+
+    template<UInt32 ... Un>
+    bool deserialize(const char* buffer, unsigned int size, MultiUnitSmartData_element<Un> & ... an) {
+        if(size < serialized_size())
+            return false;
+        deserialize(buffer, an...);
+        return true;
+    }
+
+    // Unit-tagged wire format: each element is preceded by its Unit, so records can be partial or reordered
+    static constexpr unsigned int tagged_size() { return sizeof...(Units) * sizeof(UInt32) + serialized_size(); }
+
+    unsigned int serialize_tagged(char* buffer) {
+        serialize_tagged(buffer, std::index_sequence_for<MultiUnitSmartData_element<Units>...>());
+        return tagged_size();
+    }
+
+    // Routes each tagged element to the matching MultiUnitSmartData_element<Unit>, returning the number of bytes consumed.
+    // Decoding stops at the end of the buffer, at a truncated element or at a Unit that is not part of this record.
+    unsigned int deserialize_tagged(const char* buffer, unsigned int size) {
+        static constexpr Dispatch dispatch;
+        static void (* const load[])(MultiUnitSmartData<Units...> &, const char *) = { &MultiUnitSmartData<Units...>::template load<Units>... };
+        static const unsigned int length[] = { sizeof(MultiUnitSmartData_element<Units>)... };
+
+        unsigned int i = 0;
+        while(i + sizeof(UInt32) <= size) {
+            UInt32 unit;
+            __builtin_memcpy(&unit, &buffer[i], sizeof(UInt32));
+            int slot = dispatch.find(unit);
+            if((slot < 0) || (i + sizeof(UInt32) + length[slot] > size))
+                break;
+            load[slot](*this, &buffer[i + sizeof(UInt32)]);
+            i += sizeof(UInt32) + length[slot];
+        }
+        return i;
     }
 
     template<UInt32 Unit>
@@ -89,31 +225,340 @@ public:
         return *this;
     }
 
-    struct print{
-        template<int i>
-        struct Code {
-            static void exec(MultiUnitSmartData<Units...> & msd)
-            {std::cout << "MultiUniSmartdata" << msd.template getValue<LISTV<Units ...>::template Get<i>()> << std::endl;}
-        };
+    // Applies f to every element, in order; the calls are expanded from the Units pack (no recursive instantiation)
+    template<typename F>
+    void for_each(F && f) {
+        int expand[] = { 0, (f(getElement<Units>()), 0) ... };
+        (void)expand;
+    }
+
+    void printfunc(MultiUnitSmartData<Units...> & msd){
+        msd.for_each([](auto & element) { std::cout << "MultiUniSmartdata" << element._unit << std::endl; });
+    }
+
+private:
+    typedef LIST<MultiUnitSmartData_element<Units>...> Elements;
+
+    template<typename T>
+    struct Offset {
+        static_assert(Elements::template Find<T>::Result >= 0, "Element is not part of this MultiUnitSmartData");
+        static const unsigned int Result = OFFSETOF<IF_INT<(Elements::template Find<T>::Result >= 0), Elements::template Find<T>::Result, 0>::Result, MultiUnitSmartData_element<Units>...>::Result;
     };
 
-    template<int from, class Compare, int to, int by, class Statement>
-    struct EFOR{
-        template<class MSD>
-        static void exec(MSD && msd)
-        {
-            IF<Compare::template Code<from,to>::Result,
-                    typename Statement::template Code<from>,STOP
-            >::Result::exec(msd);
-            IF<Compare::template Code<from,to>::Result,
-                    EFOR<from+by,Compare,to,by,Statement>,STOP
-            >::Result::exec(msd);
+    // Cursor over a fragmented iovec list
+    class Gather {
+    public:
+        Gather(const struct iovec* iov, unsigned int n): _iov(iov), _end(iov + n), _offset(0) {}
+
+        // Whether at least size bytes are left
+        bool holds(std::size_t size) const {
+            std::size_t offset = _offset;
+            for(const struct iovec* v = _iov; v != _end; v++, offset = 0) {
+                std::size_t available = v->iov_len - offset;
+                if(available >= size)
+                    return true;
+                size -= available;
+            }
+            return !size;
+        }
+
+        bool operator()(void* data, std::size_t size) {
+            char* d = reinterpret_cast<char*>(data);
+            while(size) {
+                if(_iov == _end)
+                    return false;
+                std::size_t available = _iov->iov_len - _offset;
+                std::size_t chunk = size < available ? size : available;
+                __builtin_memcpy(d, reinterpret_cast<const char*>(_iov->iov_base) + _offset, chunk);
+                d += chunk;
+                size -= chunk;
+                _offset += chunk;
+                if(_offset == _iov->iov_len) {
+                    _iov++;
+                    _offset = 0;
+                }
+            }
+            return true;
         }
+
+    private:
+        const struct iovec* _iov;
+        const struct iovec* _end;
+        std::size_t _offset;
     };
 
-    void printfunc(MultiUnitSmartData<Units...> & msd){
-        //std::cout << "Test" << static_cast<unsigned int>(msd.getValue<LISTV<Units ...>::template Get<2>()>(msd)) << std::endl;
-        EFOR<0, LessThan, LISTV<Units ...>::Length, +1, print>::template exec(msd);
+    template<std::size_t ... I>
+    void serialize_tagged(char* buffer, std::index_sequence<I ...>) {
+        int expand[] = { 0, (store_tagged<Units>(&buffer[I * sizeof(UInt32) + OFFSETOF<I, MultiUnitSmartData_element<Units>...>::Result]), 0) ... };
+        (void)expand;
+    }
+
+    template<UInt32 Unit>
+    void store_tagged(char* buffer) {
+        const UInt32 unit = Unit;
+        __builtin_memcpy(buffer, &unit, sizeof(UInt32));
+        __builtin_memcpy(&buffer[sizeof(UInt32)], &getElement<Unit>(), sizeof(MultiUnitSmartData_element<Unit>));
+    }
+
+    template<UInt32 Unit>
+    static void load(MultiUnitSmartData<Units...> & msd, const char* buffer) {
+        __builtin_memcpy(&msd.template getElement<Unit>(), buffer, sizeof(MultiUnitSmartData_element<Unit>));
+    }
+
+    // Compile-time dispatch table: Units sorted along with their slot in the record, so a tag is resolved by binary search
+    struct Dispatch {
+        static const unsigned int N = sizeof...(Units);
+
+        constexpr Dispatch(): units{Units...}, slots{} {
+            for(unsigned int i = 0; i < N; i++)
+                slots[i] = i;
+            for(unsigned int i = 1; i < N; i++)
+                for(unsigned int j = i; (j > 0) && (units[j - 1] > units[j]); j--) {
+                    UInt32 u = units[j]; units[j] = units[j - 1]; units[j - 1] = u;
+                    int s = slots[j]; slots[j] = slots[j - 1]; slots[j - 1] = s;
+                }
+        }
+
+        constexpr int find(UInt32 unit) const {
+            unsigned int l = 0, h = N;
+            while(l < h) {
+                unsigned int m = (l + h) / 2;
+                if(units[m] < unit)
+                    l = m + 1;
+                else
+                    h = m;
+            }
+            return ((l < N) && (units[l] == unit)) ? slots[l] : -1;
+        }
+
+        UInt32 units[N];
+        int slots[N];
+    };
+};
+
+
+// One column of a MultiUnitSmartData_Batch: the values of a single Unit for all records, contiguous and cache-line aligned
+template<unsigned int N, UInt32 Unit>
+struct MultiUnitSmartData_column {
+public:
+    typedef typename MultiUnitSmartData_element<Unit>::Value Value;
+
+    alignas(64) Value _values[N];
+};
+
+
+// Structure-of-arrays container for up to N records of the same Units: each Unit's values live in their own column
+template <unsigned int N, UInt32... Units>
+struct MultiUnitSmartData_Batch : public LIST<MultiUnitSmartData_column<N, Units>...>::Recur{
+public:
+    typedef MultiUnitSmartData<Units...> Record;
+
+    MultiUnitSmartData_Batch(): _size(0) {}
+
+    static constexpr unsigned int capacity() { return N; }
+    unsigned int size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    bool full() const { return _size == N; }
+    void clear() { _size = 0; }
+
+    template<UInt32 Unit>
+    typename MultiUnitSmartData_column<N, Unit>::Value * getColumn() {
+        return this->MultiUnitSmartData_column<N, Unit>::_values;
+    }
+
+    template<UInt32 Unit>
+    const typename MultiUnitSmartData_column<N, Unit>::Value * getColumn() const {
+        return this->MultiUnitSmartData_column<N, Unit>::_values;
+    }
+
+    bool append(Record & record) {
+        if(full())
+            return false;
+        int expand[] = { 0, (getColumn<Units>()[_size] = record.template getElement<Units>().a, 0) ... };
+        (void)expand;
+        _size++;
+        return true;
+    }
+
+    // Appends up to n records laid out back to back by MultiUnitSmartData::serialize(), returning how many fit
+    unsigned int append(const char* buffer, unsigned int n) {
+        if(n > N - _size)
+            n = N - _size;
+        append(buffer, n, std::index_sequence_for<MultiUnitSmartData_element<Units>...>());
+        _size += n;
+        return n;
+    }
+
+    // Writes all records back to back in the MultiUnitSmartData::serialize() layout, returning the number of bytes written
+    unsigned int serialize(char* buffer) const {
+        serialize(buffer, std::index_sequence_for<MultiUnitSmartData_element<Units>...>());
+        return _size * Record::serialized_size();
+    }
+
+private:
+    template<std::size_t ... I>
+    void append(const char* buffer, unsigned int n, std::index_sequence<I ...>) {
+        int expand[] = { 0, (load_column<Units>(&buffer[OFFSETOF<I, MultiUnitSmartData_element<Units>...>::Result], n), 0) ... };
+        (void)expand;
+    }
+
+    template<std::size_t ... I>
+    void serialize(char* buffer, std::index_sequence<I ...>) const {
+        int expand[] = { 0, (store_column<Units>(&buffer[OFFSETOF<I, MultiUnitSmartData_element<Units>...>::Result]), 0) ... };
+        (void)expand;
     }
+
+    // Gathers one Unit's values from n serialized records into its column
+    template<UInt32 Unit>
+    void load_column(const char* element, unsigned int n) {
+        typedef typename MultiUnitSmartData_element<Unit>::Value Value;
+        Value * column = &getColumn<Unit>()[_size];
+        for(unsigned int i = 0; i < n; i++)
+            __builtin_memcpy(&column[i], &element[i * Record::serialized_size() + offsetof(MultiUnitSmartData_element<Unit>, a)], sizeof(Value));
+    }
+
+    // Scatters one Unit's column into the serialized records
+    template<UInt32 Unit>
+    void store_column(char* element) const {
+        const typename MultiUnitSmartData_element<Unit>::Value * column = getColumn<Unit>();
+        MultiUnitSmartData_element<Unit> e;
+        for(unsigned int i = 0; i < _size; i++) {
+            e.a = column[i];
+            __builtin_memcpy(&element[i * Record::serialized_size()], &e, sizeof(MultiUnitSmartData_element<Unit>));
+        }
+    }
+
+private:
+    unsigned int _size;
 };
 
+
+// Compressed stream of timestamped MultiUnitSmartData samples: each element is encoded against the same element of the
+// previous sample (zig-zag delta varints for integers, byte-aligned XOR for floating point) and time (in us) as a
+// zig-zag varint of its delta-of-delta, so steady periods and slowly changing values take about one byte each
+template <UInt32... Units>
+class MultiUnitSmartData_Encoder {
+public:
+    typedef MultiUnitSmartData<Units...> Record;
+    typedef Int64 Time; // in us, as Space_Time::Time::Type
+
+    // Worst-case encoded size of a single sample
+    static const unsigned int MAX_RECORD_SIZE = Varint::MAX<sizeof(Time)>::Result + SUM<Varint::MAX<sizeof(typename MultiUnitSmartData_element<Units>::Value)>::Result...>::Result;
+
+public:
+    MultiUnitSmartData_Encoder(char* buffer, unsigned int size)
+    : _begin(reinterpret_cast<unsigned char *>(buffer)), _p(_begin), _end(_begin + size), _time(0), _delta(0) {
+        int expand[] = { 0, (_last.template getElement<Units>().a = 0, 0) ... };
+        (void)expand;
+    }
+
+    // Appends a sample, returning false (and writing nothing) if the buffer could not hold it
+    bool encode(const Time & time, Record & record) {
+        if(static_cast<unsigned int>(_end - _p) < MAX_RECORD_SIZE)
+            return false;
+
+        Time delta = time - _time;
+        Varint::put(_p, Varint::zigzag(delta - _delta));
+        _time = time;
+        _delta = delta;
+
+        int expand[] = { 0, (encode<Units>(record), 0) ... };
+        (void)expand;
+        return true;
+    }
+
+    unsigned int length() const { return _p - _begin; }
+
+private:
+    template<UInt32 Unit>
+    void encode(Record & record) {
+        typename MultiUnitSmartData_element<Unit>::Value & last = _last.template getElement<Unit>().a;
+        Varint::put_delta(_p, record.template getElement<Unit>().a, last);
+        last = record.template getElement<Unit>().a;
+    }
+
+private:
+    unsigned char * _begin;
+    unsigned char * _p;
+    unsigned char * _end;
+    Time _time;
+    Time _delta;
+    Record _last;
+};
+
+
+// Decodes streams produced by MultiUnitSmartData_Encoder (which never writes partial samples). A sample is decoded
+// against one copy of the previous one into the other, so a truncated or corrupt one leaves the decoder as it was.
+// While a whole worst-case sample (MAX_RECORD_SIZE) remains, the end of the stream is tested once per sample instead
+// of once per byte.
+template <UInt32... Units>
+class MultiUnitSmartData_Decoder {
+public:
+    typedef MultiUnitSmartData<Units...> Record;
+    typedef Int64 Time; // in us, as Space_Time::Time::Type
+
+    static const unsigned int MAX_RECORD_SIZE = MultiUnitSmartData_Encoder<Units...>::MAX_RECORD_SIZE;
+
+public:
+    MultiUnitSmartData_Decoder(const char* buffer, unsigned int size)
+    : _p(reinterpret_cast<const unsigned char *>(buffer)), _end(_p + size), _time(0), _delta(0), _current(0) {
+        int expand[] = { 0, (_last[0].template getElement<Units>().a = 0, 0) ... };
+        (void)expand;
+    }
+
+    // Extracts the next sample, returning false (and leaving time and record untouched) at the end of the stream or on
+    // a truncated or corrupt sample
+    bool decode(Time & time, Record & record) {
+        const unsigned char * p = _p;
+        unsigned long long dd;
+        Record & last = _last[_current];
+        Record & next = _last[_current ^ 1];
+        bool ok = true;
+        if(static_cast<unsigned long>(_end - p) >= MAX_RECORD_SIZE) {
+            ok = Varint::get<sizeof(Time)>(p, dd);
+            int expand[] = { 0, (ok &= decode<Units>(p, last, next), 0) ... };
+            (void)expand;
+        } else {
+            ok = Varint::get(p, _end, dd);
+            int expand[] = { 0, (ok = ok && decode<Units>(p, _end, last, next), 0) ... };
+            (void)expand;
+        }
+        if(!ok)
+            return false;
+
+        _p = p;
+        _current ^= 1;
+        _delta += Varint::unzigzag(dd);
+        _time += _delta;
+        time = _time;
+        int copy[] = { 0, (record.template getElement<Units>().a = next.template getElement<Units>().a, 0) ... };
+        (void)copy;
+        return true;
+    }
+
+private:
+    template<UInt32 Unit>
+    static bool decode(const unsigned char * & p, const unsigned char * end, Record & last, Record & next) {
+        typename MultiUnitSmartData_element<Unit>::Value v = last.template getElement<Unit>().a;
+        bool ok = Varint::get_delta(p, end, v);
+        next.template getElement<Unit>().a = v;
+        return ok;
+    }
+
+    // Unchecked, with a whole worst-case sample left
+    template<UInt32 Unit>
+    static bool decode(const unsigned char * & p, Record & last, Record & next) {
+        typename MultiUnitSmartData_element<Unit>::Value v = last.template getElement<Unit>().a;
+        bool ok = Varint::get_delta(p, v);
+        next.template getElement<Unit>().a = v;
+        return ok;
+    }
+
+private:
+    const unsigned char * _p;
+    const unsigned char * _end;
+    Time _time;
+    Time _delta;
+    Record _last[2];
+    unsigned int _current;
+};
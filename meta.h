@@ -4,6 +4,8 @@
 #define __meta_h
 
 #include <iostream>
+#include <utility>
+#include <initializer_list>
 
 // Native type wrapper (POD)
 template <typename T1>
@@ -187,76 +189,109 @@ constexpr bool INARRAY(const T (& array)[N], const T & value) {
 }
 
 
+// Constant expressions over Packages (loops instead of recursion, so the instantiation depth does not grow with the Package)
+template<typename T>
+constexpr T PACK_SUM(std::initializer_list<T> values, unsigned int count = ~0u) {
+    T sum = 0;
+    unsigned int i = 0;
+    for(const T & v : values) {
+        if(i++ >= count) break;
+        sum += v;
+    }
+    return sum;
+}
+
+template<typename T>
+constexpr int PACK_FIND(std::initializer_list<T> values, const T & value, int start = 0) {
+    int i = 0;
+    for(const T & v : values) {
+        if((i >= start) && (v == value)) return i;
+        i++;
+    }
+    return -1;
+}
+
+template<typename T>
+constexpr unsigned int PACK_COUNT(std::initializer_list<T> values, const T & value) {
+    unsigned int count = 0;
+    for(const T & v : values)
+        if(v == value) count++;
+    return count;
+}
+
+template<typename T>
+constexpr T PACK_GET(std::initializer_list<T> values, unsigned int index, const T & otherwise) {
+    return (index < values.size()) ? values.begin()[index] : otherwise;
+}
+
+
 // SIZEOF Type Package
 template<typename ... Tn>
 struct SIZEOF
-{ static const unsigned int  Result = 0; };
-template<typename T1, typename ... Tn>
-struct SIZEOF<T1, Tn ...>
-{ static const unsigned int Result = sizeof(T1) + SIZEOF<Tn ...>::Result ; };
+{ static const unsigned int Result = PACK_SUM<unsigned int>({ sizeof(Tn) ... }); };
 
 
 // LIST of Types
-template<typename ... Tn> class LIST;
-template<typename T1, typename ... Tn>
-class LIST<T1, Tn ...>
+template<typename ... Tn>
+class LIST
 {
-protected:
-    typedef T1 Head;
-    typedef LIST<Tn ...> Tail;
-
-public:
-    enum { Length = Tail::Length + 1 };
-
-    template<int Index, int Current = 0, bool Stop = (Index == Current)>
-    struct Get
-    { typedef typename Tail::template Get<Index, Current + 1>::Result Result; };
-
-    template<int Index, int Current>
-    struct Get<Index, Current, true>
-    { typedef Head Result; };
-
-    template<typename Type, int Start = 0, int Current = 0, bool Stop = ((Current >= Start) && EQUAL<Head, Type>::Result)>
-    struct Find
-    { enum { Result = Tail::template Find<Type, Start, Current + 1>::Result }; };
+private:
+    // Each Type tagged with its position, so Get resolves by overload resolution instead of walking the LIST
+    template<std::size_t Index, typename T>
+    struct Slot: public T {};
 
-    template<typename Type, int Start, int Current>
-    struct Find<Type, Start, Current, true>
-    { enum { Result = Current }; };
+    template<std::size_t Index, typename T>
+    struct Tag { typedef T Type; };
 
-    template<typename Type>
-    struct Count
-    { enum { Result = EQUAL<Head, Type>::Result + Tail::template Count<Type>::Result }; };
+    template<typename Sequence> struct Tags;
+    template<std::size_t ... I>
+    struct Tags<std::index_sequence<I ...>>: public Tag<I, Tn> ... {};
 
-    struct Recur: public Head, public Tail::Recur {};
+    template<std::size_t Index, typename T>
+    static Tag<Index, T> tag(const Tag<Index, T> &);
 
-    enum { Polymorphic = (int(Length) != int(Count<Head>::Result)) };
-};
+    template<typename Sequence> struct Slots;
+    template<std::size_t ... I>
+    struct Slots<std::index_sequence<I ...>>: public Slot<I, Tn> ... {};
 
-template<>
-class LIST<>
-{
 public:
-    enum { Length = 0 };
+    enum { Length = sizeof...(Tn) };
 
-    template<int Index, int Current = 0>
+    template<int Index, bool Valid = ((Index >= 0) && (Index < int(sizeof...(Tn))))>
     struct Get
+    { typedef typename decltype(tag<Index>(std::declval<Tags<std::index_sequence_for<Tn ...>>>()))::Type Result; };
+
+    template<int Index>
+    struct Get<Index, false>
     { typedef void Result; };
 
-    template<typename Type, int Start = 0, int Current = 0>
+    template<typename Type, int Start = 0>
     struct Find
-    { enum { Result = -1 }; };
+    { enum { Result = PACK_FIND<bool>({ bool(EQUAL<Tn, Type>::Result) ... }, true, Start) }; };
 
     template<typename Type>
     struct Count
-    { enum { Result = 0 }; };
+    { enum { Result = PACK_COUNT<bool>({ bool(EQUAL<Tn, Type>::Result) ... }, true) }; };
 
-    struct Recur {};
+    // All Types as bases of a single class, in order (the wrapping Slots allow repeated Types)
+    struct Recur: public Slots<std::index_sequence_for<Tn ...>> {};
 
-    enum { Polymorphic = false };
+    enum { Polymorphic = (int(Length) != int(Count<typename Get<0>::Result>::Result)) };
 };
 
 
+// SUM of an Integer Package
+template<unsigned int ... In>
+struct SUM
+{ static const unsigned int Result = PACK_SUM<unsigned int>({ In ... }); };
+
+
+// OFFSETOF the Index-th Type of a Package (i.e. the SIZEOF all Types before it)
+template<int Index, typename ... Tn>
+struct OFFSETOF
+{ static const unsigned int Result = PACK_SUM<unsigned int>({ sizeof(Tn) ... }, Index); };
+
+
 // LIST of Templates
 template<template<typename T> class ... Tn> class ALIST;
 template<template<typename T> class T1, template<typename T> class T2, template<typename T> class ... Tn>
@@ -358,30 +393,21 @@ struct UnsignedInt {
     static constexpr unsigned int value = Value;
 };
 
-template <unsigned int T1, unsigned int... Tn>
-struct LISTV<T1, Tn...>
+// LIST of Values (lookups are constant expressions over the Package, without recursive instantiation)
+template <unsigned int... Tn>
+struct LISTV
 {
-    static constexpr unsigned int Length = sizeof...(Tn) + 1;
+    static constexpr unsigned int Length = sizeof...(Tn);
 
     template <unsigned int Index>
     static constexpr unsigned int Get()
     {
-        //static_assert(Index < Length, "Index out of bounds");
-        return Index == 0 ? T1 : LISTV<Tn...>::template Get<Index - 1>();
+        return PACK_GET<unsigned int>({ Tn... }, Index, 0); // 0 if Index is out of bounds
     }
-};
 
-template <>
-struct LISTV<>
-{
-    static constexpr unsigned int Length = 0;
+    static constexpr int Find(unsigned int value, int start = 0) { return PACK_FIND<unsigned int>({ Tn... }, value, start); }
 
-    template <unsigned int Index>
-    static constexpr unsigned int Get()
-    {
-        //static_assert(Index == 0, "Index out of bounds");
-        return 0; // You can provide a default value or throw an exception here
-    }
+    static constexpr unsigned int Count(unsigned int value) { return PACK_COUNT<unsigned int>({ Tn... }, value); }
 };
 
 struct LessThan {
@@ -463,6 +489,31 @@ void DESERIALIZE(char * buf, int index, T && a, Tn && ... an) {
 }
 
 
+// Static Serializer: all offsets are resolved at compile time, so (de)serializing a package
+// unfolds into a straight sequence of fixed-size copies at fixed offsets (and prints nothing)
+template<typename ... Tn>
+struct SERIALIZER
+{
+    static constexpr unsigned int size() { return SIZEOF<Tn ...>::Result; }
+
+    static void serialize(char * buf, const Tn & ... an) { serialize(buf, std::index_sequence_for<Tn ...>(), an ...); }
+    static void deserialize(const char * buf, Tn & ... an) { deserialize(buf, std::index_sequence_for<Tn ...>(), an ...); }
+
+private:
+    template<std::size_t ... I>
+    static void serialize(char * buf, std::index_sequence<I ...>, const Tn & ... an) {
+        int expand[] = { 0, (__builtin_memcpy(&buf[OFFSETOF<I, Tn ...>::Result], &an, sizeof(Tn)), 0) ... };
+        (void)expand;
+    }
+
+    template<std::size_t ... I>
+    static void deserialize(const char * buf, std::index_sequence<I ...>, Tn & ... an) {
+        int expand[] = { 0, (__builtin_memcpy(&an, &buf[OFFSETOF<I, Tn ...>::Result], sizeof(Tn)), 0) ... };
+        (void)expand;
+    }
+};
+
+
 // Returns the UNSIGNED counterpart of primitive type T
 template<typename T>
 struct UNSIGNED {
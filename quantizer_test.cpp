@@ -0,0 +1,82 @@
+#include "utility/quantizer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+// Quantizer round trips: every frame fits in max_size() and decodes to within the uncertainty (or exactly, if raw)
+
+static unsigned int failures = 0;
+
+template<typename T>
+void check(const char * name, const T * samples, unsigned int n, double uncertainty, bool raw)
+{
+    static char frame[1 << 16];
+    static T decoded[1 << 12];
+
+    unsigned long size = Quantizer<T>::max_size(n);
+    unsigned long length = Quantizer<T>::encode(frame, size, samples, n, uncertainty);
+    bool ok = (length > 0) && (length <= size) && ((static_cast<unsigned char>(frame[sizeof(typename Quantizer<T>::Header) - 1]) == Quantizer<T>::RAW) == raw);
+    ok = ok && (Quantizer<T>::decode(decoded, n, frame, length) == n);
+    for(unsigned int i = 0; ok && (i < n); i++)
+        ok = raw ? (decoded[i] == samples[i]) : (std::fabs(static_cast<double>(decoded[i]) - samples[i]) <= uncertainty + 2 * std::fabs(samples[i]) * std::numeric_limits<T>::epsilon());
+
+    printf("%-40s %s (%lu of %lu bytes)\n", name, ok ? "ok" : "FAILED", length, size);
+    if(!ok)
+        failures++;
+}
+
+int main()
+{
+    static float f[4096];
+    static double d[4096];
+    static char frame[1 << 12];
+
+    // Ranges too wide for a packing narrower than T itself must go raw instead of overflowing max_size()
+    for(unsigned int i = 0; i < 64; i++)
+        f[i] = (i & 1) ? 1e6f : 0;
+    check("float {0, 1e6} at 1e-6", f, 64, 1e-6, true);
+
+    for(unsigned int i = 0; i < 64; i++)
+        d[i] = (i & 1) ? 1e9 : 0;
+    check("double {0, 1e9} at 1e-6 (packed)", d, 64, 1e-6, false);
+    check("double {0, 1e9} at 1e-9 (raw)", d, 64, 1e-9, true);
+
+    // Non-finite samples and no uncertainty
+    f[3] = INFINITY;
+    check("float with an infinity", f, 64, 1, true);
+    check("float without uncertainty", f, 64, 0, true);
+
+    // Smooth series quantize
+    for(unsigned int i = 0; i < 4096; i++) {
+        f[i] = 20 + std::sin(i * 0.01f) * 5;
+        d[i] = 230 + std::sin(i * 0.003) * 10;
+    }
+    check("float sine at 0.01", f, 4096, 0.01, false);
+    check("double sine at 1e-4", d, 4096, 1e-4, false);
+
+    // Constant series take no bits at all
+    for(unsigned int i = 0; i < 100; i++)
+        d[i] = 42.5;
+    check("double constant", d, 100, 0.1, false);
+
+    // Random widths and ranges never exceed max_size()
+    srand(1);
+    unsigned int overflows = 0;
+    for(unsigned int k = 0; k < 1000; k++) {
+        unsigned int n = 1 + rand() % 256;
+        double scale = std::pow(10.0, rand() % 20 - 5);
+        for(unsigned int i = 0; i < n; i++)
+            f[i] = static_cast<float>((rand() / double(RAND_MAX) - 0.5) * scale);
+        double uncertainty = std::pow(10.0, rand() % 16 - 10);
+        unsigned long length = Quantizer<float>::encode(frame, Quantizer<float>::max_size(n), f, n, uncertainty);
+        if(!length)
+            overflows++;
+    }
+    printf("%-40s %s (%u of 1000 frames over max_size())\n", "random floats", overflows ? "FAILED" : "ok", overflows);
+    if(overflows)
+        failures++;
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
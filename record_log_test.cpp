@@ -0,0 +1,167 @@
+#include "utility/record_log.h"
+#include <cstdio>
+#include <cstdlib>
+
+// Record_Log round trips: segment file format, reads and seeks across segments, writer restarts (also after one stopped
+// right after opening a segment), and seeks over a log with an empty segment left between two others
+
+struct Sample
+{
+    static constexpr unsigned int serialized_size() { return sizeof(int) + sizeof(double); }
+
+    void serialize(char * buffer) const {
+        __builtin_memcpy(buffer, &id, sizeof(int));
+        __builtin_memcpy(buffer + sizeof(int), &value, sizeof(double));
+    }
+    void deserialize(const char * buffer) {
+        __builtin_memcpy(&id, buffer, sizeof(int));
+        __builtin_memcpy(&value, buffer + sizeof(int), sizeof(double));
+    }
+
+    int id;
+    double value;
+};
+
+typedef Record_Log<Sample, 8> Log;
+
+static const unsigned int CAPACITY = 100;
+
+static unsigned int failures = 0;
+
+static void check(const char * name, bool ok)
+{
+    printf("%-50s %s\n", name, ok ? "ok" : "FAILED");
+    if(!ok)
+        failures++;
+}
+
+// Record i is taken at 10 * (i / 3) us, so times repeat
+static Log::Time time_of(unsigned int i) { return 10 * (i / 3); }
+
+static bool append(Log::Writer & w, unsigned int from, unsigned int to)
+{
+    for(unsigned int i = from; i < to; i++) {
+        Sample s = { static_cast<int>(i), i * 0.5 };
+        if(!w.append(time_of(i), s))
+            return false;
+    }
+    return true;
+}
+
+// Every record reads back, and seeks agree with a linear search for every time in (and around) the log
+static bool verify(const char * prefix, unsigned int n)
+{
+    Log::Reader r;
+    if(!r.open(prefix) || (r.count() != n))
+        return false;
+    for(unsigned int i = 0; i < n; i++) {
+        Sample s;
+        r.read(i, s);
+        if((s.id != static_cast<int>(i)) || (s.value != i * 0.5) || (r.time(i) != time_of(i)))
+            return false;
+    }
+    for(Log::Time t = -5; t <= time_of(n) + 15; t++) {
+        Log::Reader::Position p = 0;
+        while((p < n) && (time_of(p) < t))
+            p++;
+        if(r.seek(t) != p)
+            return false;
+    }
+    return true;
+}
+
+// Writes an empty (but valid) segment, as left by a writer that stopped right after opening it
+static bool empty_segment(const char * prefix, unsigned int sequence)
+{
+    char name[256];
+    snprintf(name, sizeof(name), "%s.%06u.log", prefix, sequence);
+    FILE * f = fopen(name, "wb");
+    if(!f)
+        return false;
+    Log::Header h = { Log::MAGIC, Log::ENTRY_SIZE, CAPACITY, 8, 0, 0, 0, 0 };
+    bool ok = (fwrite(&h, sizeof(h), 1, f) == 1) && !ftruncate(fileno(f), Log::segment_size(CAPACITY));
+    return !fclose(f) && ok;
+}
+
+static void clean(const char * prefix)
+{
+    for(unsigned int s = 0; s < 16; s++) {
+        char name[256];
+        snprintf(name, sizeof(name), "%s.%06u.log", prefix, s);
+        unlink(name);
+    }
+}
+
+int main()
+{
+    char dir[] = "/tmp/record_log_test.XXXXXX";
+    if(!mkdtemp(dir)) {
+        printf("FAILED (no temporary directory)\n");
+        return 1;
+    }
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%s/log", dir);
+
+    // Three segments, the last one partial
+    {
+        Log::Writer w(prefix, CAPACITY);
+        check("append 250 records", append(w, 0, 250));
+        Sample s = { -1, 0 };
+        check("time going backwards is refused", !w.append(time_of(249) - 1, s));
+        check("three segments", w.sequence() == 3);
+    }
+    check("read and seek across segments", verify(prefix, 250));
+
+    // Segment file format
+    {
+        char name[256];
+        snprintf(name, sizeof(name), "%s.%06u.log", prefix, 1);
+        FILE * f = fopen(name, "rb");
+        Log::Header h;
+        bool ok = f && (fread(&h, sizeof(h), 1, f) == 1);
+        ok = ok && (h.magic == Log::MAGIC) && (h.entry_size == sizeof(Log::Time) + Sample::serialized_size()) && (h.capacity == CAPACITY);
+        ok = ok && (h.stride == 8) && (h.count == CAPACITY) && (h.t0 == time_of(100)) && (h.t1 == time_of(199));
+        Log::Time t;
+        Sample s;
+        ok = ok && !fseek(f, sizeof(Log::Header) + ((CAPACITY + 7) / 8) * sizeof(Log::Time) + 5 * Log::ENTRY_SIZE, SEEK_SET);
+        ok = ok && (fread(&t, sizeof(t), 1, f) == 1) && (fread(&s, Sample::serialized_size(), 1, f) == 1);
+        ok = ok && (t == time_of(105)) && (s.id == 105);
+        if(f)
+            fclose(f);
+        check("segment header and entry layout", ok);
+    }
+
+    // A restarted writer goes on after the last segment, keeping time order
+    {
+        Log::Writer w(prefix, CAPACITY);
+        Sample s = { -1, 0 };
+        check("restarted writer refuses earlier times", !w.append(time_of(249) - 1, s));
+        check("restarted writer appends", append(w, 250, 320));
+        check("restarted writer opens a new segment", w.sequence() == 4);
+    }
+    check("read and seek after a restart", verify(prefix, 320));
+
+    // A writer that stopped right after opening a segment leaves it empty; the next one reuses its sequence number
+    check("empty last segment", empty_segment(prefix, 4));
+    {
+        Log::Writer w(prefix, CAPACITY);
+        check("writer after an empty segment appends", append(w, 320, 400));
+        check("empty last segment reused", w.sequence() == 5);
+    }
+    check("read and seek after an empty segment", verify(prefix, 400));
+
+    // Readers also skip empty segments between others (e.g. left by older writers)
+    {
+        char from[256], to[256];
+        snprintf(from, sizeof(from), "%s.%06u.log", prefix, 4);
+        snprintf(to, sizeof(to), "%s.%06u.log", prefix, 6);
+        check("empty segments in the middle", !rename(from, to) && empty_segment(prefix, 4) && empty_segment(prefix, 5));
+    }
+    check("read and seek over an empty segment", verify(prefix, 400));
+
+    clean(prefix);
+    rmdir(dir);
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
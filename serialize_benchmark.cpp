@@ -0,0 +1,247 @@
+#include "inheritance_test.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <streambuf>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Serialization micro-benchmark suite: SERIALIZER (production) and SERIALIZE/DESERIALIZE (legacy, with their output
+// discarded), a plain memcpy of the packed record, MultiUnitSmartData get/set, and the big-endian Value<UNIT> batch
+// conversions (Endian::htobe, as used by SmartData::Value::encode), and MultiUnitSmartData_Decoder on a compressed stream
+// of steadily sampled, slowly changing records (its bytes are those of the decoded time and values), for records of 1,
+// 8, 64 and 256 units.
+// Reports ns/record, bytes/s and cache misses/record (through perf_event_open, when available) and writes them as JSON.
+//
+// Usage: serialize_benchmark [output.json]
+
+// Keeps the compiler from discarding the stores into a buffer
+inline void clobber(void * p) { asm volatile("" : : "r"(p) : "memory"); }
+
+// Counts hardware cache misses of this thread; count() is -1 if the PMU is not available (e.g. in containers)
+class Cache_Miss_Counter
+{
+public:
+    Cache_Miss_Counter() {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~Cache_Miss_Counter() { if(_fd >= 0) close(_fd); }
+
+    void start() {
+        if(_fd < 0)
+            return;
+        ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    long long stop() {
+        if(_fd < 0)
+            return -1;
+        ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count;
+        if(read(_fd, &count, sizeof(count)) != sizeof(count))
+            return -1;
+        return count;
+    }
+
+private:
+    int _fd;
+};
+
+// Swallows whatever the legacy SERIALIZE/DESERIALIZE print, so only their formatting cost is measured
+class Null_Buffer: public std::streambuf
+{
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) { return n; }
+};
+
+struct Result
+{
+    const char * name;
+    unsigned int units;
+    unsigned int bytes;
+    double ns;
+    double cache_misses;
+};
+
+static std::vector<Result> results;
+static Cache_Miss_Counter counter;
+
+template<typename F>
+void measure(const char * name, unsigned int units, unsigned int bytes, unsigned int iterations, F && f)
+{
+    f(); // warm up
+
+    counter.start();
+    auto begin = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < iterations; i++)
+        f();
+    auto end = std::chrono::steady_clock::now();
+    long long misses = counter.stop();
+
+    Result r = { name, units, bytes, std::chrono::duration<double, std::nano>(end - begin).count() / iterations, misses < 0 ? -1 : double(misses) / iterations };
+    results.push_back(r);
+
+    printf("%-20s %4u units %7.2f ns/record %9.3f GB/s", name, units, r.ns, bytes / r.ns);
+    if(r.cache_misses >= 0)
+        printf(" %8.3f misses/record", r.cache_misses);
+    printf("\n");
+}
+
+// MultiUnitSmartData<1, 2, ..., N>
+template<typename Sequence> struct Make_Record;
+template<std::size_t ... I>
+struct Make_Record<std::index_sequence<I ...>> {
+    typedef MultiUnitSmartData<(I + 1)...> Result;
+    typedef MultiUnitSmartData_Encoder<(I + 1)...> Encoder;
+    typedef MultiUnitSmartData_Decoder<(I + 1)...> Decoder;
+};
+
+template<unsigned int N>
+struct Suite
+{
+    typedef typename Make_Record<std::make_index_sequence<N>>::Result Record;
+    typedef typename Make_Record<std::make_index_sequence<N>>::Encoder Encoder;
+    typedef typename Make_Record<std::make_index_sequence<N>>::Decoder Decoder;
+
+    template<std::size_t ... I>
+    static void set(Record & record, unsigned int v, std::index_sequence<I ...>) {
+        int expand[] = { 0, (record.template setValue<I + 1>(v + I), 0) ... };
+        (void)expand;
+    }
+
+    template<std::size_t ... I>
+    static int get(Record & record, std::index_sequence<I ...>) {
+        int sum = 0;
+        int expand[] = { 0, (sum += record.template getElement<I + 1>().a, 0) ... };
+        (void)expand;
+        return sum;
+    }
+
+    template<std::size_t ... I>
+    static void legacy_serialize(Record & record, char * buffer, std::index_sequence<I ...>) {
+        SERIALIZE(buffer, 0, record.template getElement<I + 1>()...);
+    }
+
+    template<std::size_t ... I>
+    static void legacy_deserialize(Record & record, char * buffer, std::index_sequence<I ...>) {
+        DESERIALIZE(buffer, 0, record.template getElement<I + 1>()...);
+    }
+
+    static void run() {
+        static const unsigned int SIZE = Record::serialized_size();
+        static const unsigned int ITERATIONS = 4000000 / N + 1000;
+        static const unsigned int SAMPLES = 1024;
+
+        static Record record;
+        static Record restored;
+        static char buffer[SIZE];
+        static int i32[N];
+        static double d64[N];
+        static char wire[N * sizeof(double)];
+        static char stream[SAMPLES * Encoder::MAX_RECORD_SIZE];
+
+        set(record, 1, std::make_index_sequence<N>());
+        for(unsigned int i = 0; i < N; i++) {
+            i32[i] = i;
+            d64[i] = i * 1.5;
+        }
+
+        measure("serialize", N, SIZE, ITERATIONS, [&]() { record.serialize(buffer); clobber(buffer); });
+        measure("deserialize", N, SIZE, ITERATIONS, [&]() { restored.deserialize(buffer); clobber(&restored); });
+        measure("memcpy", N, SIZE, ITERATIONS, [&]() { memcpy(buffer, &record, sizeof(Record)); clobber(buffer); });
+
+        std::streambuf * out = std::cout.rdbuf();
+        Null_Buffer null;
+        std::cout.rdbuf(&null);
+        measure("legacy_serialize", N, SIZE, ITERATIONS / 100 + 1, [&]() { legacy_serialize(record, buffer, std::make_index_sequence<N>()); clobber(buffer); });
+        measure("legacy_deserialize", N, SIZE, ITERATIONS / 100 + 1, [&]() { legacy_deserialize(restored, buffer, std::make_index_sequence<N>()); clobber(&restored); });
+        std::cout.rdbuf(out);
+
+        measure("set", N, SIZE, ITERATIONS, [&]() { set(record, 2, std::make_index_sequence<N>()); clobber(&record); });
+        measure("get", N, SIZE, ITERATIONS, [&]() { volatile int sum = get(record, std::make_index_sequence<N>()); (void)sum; });
+
+        measure("value_encode_i32", N, N * sizeof(int), ITERATIONS, [&]() { Endian::htobe<sizeof(int)>(wire, i32, N); clobber(wire); });
+        measure("value_decode_i32", N, N * sizeof(int), ITERATIONS, [&]() { Endian::betoh<sizeof(int)>(i32, wire, N); clobber(i32); });
+        measure("value_encode_d64", N, N * sizeof(double), ITERATIONS, [&]() { Endian::htobe<sizeof(double)>(wire, d64, N); clobber(wire); });
+        measure("value_decode_d64", N, N * sizeof(double), ITERATIONS, [&]() { Endian::betoh<sizeof(double)>(d64, wire, N); clobber(d64); });
+
+        // Samples every 1 ms with jitter, values drifting by one every fourth sample
+        Encoder encoder(stream, sizeof(stream));
+        for(unsigned int i = 0; i < SAMPLES; i++) {
+            set(record, i / 4, std::make_index_sequence<N>());
+            encoder.encode(i * 1000 + (i % 3), record);
+        }
+        unsigned int length = encoder.length();
+        Decoder decoder(stream, length);
+        typename Decoder::Time time;
+        measure("stream_decode", N, sizeof(time) + N * sizeof(int), ITERATIONS, [&]() {
+            if(!decoder.decode(time, restored)) {
+                decoder = Decoder(stream, length);
+                decoder.decode(time, restored);
+            }
+            clobber(&restored);
+        });
+        printf("%-20s %4u units %7.2f bytes/record\n", "stream_size", N, double(length) / SAMPLES);
+
+        decoder = Decoder(stream, length);
+        for(unsigned int i = 0; i < SAMPLES; i++) {
+            set(record, i / 4, std::make_index_sequence<N>());
+            if(!decoder.decode(time, restored) || (time != i * 1000 + (i % 3)) || memcmp(&restored, &record, sizeof(Record))) {
+                printf("stream encode/decode mismatch for %u units\n", N);
+                exit(1);
+            }
+        }
+        set(record, 1, std::make_index_sequence<N>());
+
+        static_assert(Record::serialized_size() == sizeof(Record), "Record is not packed");
+        record.serialize(buffer);
+        restored.deserialize(buffer);
+        if(memcmp(&restored, &record, sizeof(Record)) || memcmp(buffer, &record, sizeof(Record))) {
+            printf("serialize/deserialize mismatch for %u units\n", N);
+            exit(1);
+        }
+    }
+};
+
+int main(int argc, char * argv[])
+{
+    Suite<1>::run();
+    Suite<8>::run();
+    Suite<64>::run();
+    Suite<256>::run();
+
+    const char * path = (argc > 1) ? argv[1] : "serialize_benchmark.json";
+    FILE * json = fopen(path, "w");
+    if(!json) {
+        perror(path);
+        return 1;
+    }
+    fprintf(json, "{\n  \"benchmarks\": [\n");
+    for(unsigned int i = 0; i < results.size(); i++) {
+        const Result & r = results[i];
+        fprintf(json, "    {\"name\": \"%s\", \"units\": %u, \"bytes\": %u, \"ns_per_record\": %.4f, \"bytes_per_second\": %.1f, \"cache_misses_per_record\": ",
+                r.name, r.units, r.bytes, r.ns, r.bytes * 1e9 / r.ns);
+        if(r.cache_misses >= 0)
+            fprintf(json, "%.4f}", r.cache_misses);
+        else
+            fprintf(json, "null}");
+        fprintf(json, "%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(json, "  ]\n}\n");
+    fclose(json);
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include "inheritance_test.h"
+
+// Compile-time benchmark: instantiates a MultiUnitSmartData with UNITS units (256 by default) through every entry
+// point that resolves Units at compile time. It is built with a small -ftemplate-depth, so it fails to compile if any
+// of them regresses to recursive instantiation; time its build to track compile-time costs, e.g.
+//   time c++ -std=c++14 -I. -ftemplate-depth=32 -DUNITS=512 -c template_benchmark.cpp
+
+#ifndef UNITS
+#define UNITS 256
+#endif
+
+template<typename Sequence> struct Make_Record;
+template<std::size_t ... I>
+struct Make_Record<std::index_sequence<I ...>> { typedef MultiUnitSmartData<(I + 1)...> Result; };
+
+typedef Make_Record<std::make_index_sequence<UNITS>>::Result Record;
+
+static_assert(Record::serialized_size() == UNITS * sizeof(MultiUnitSmartData_element<1>), "Wrong serialized size");
+static_assert(LISTV<UNITS, 1>::Find(1) == 1, "LISTV::Find is broken");
+
+int main()
+{
+    static Record record;
+    static Record restored;
+    static char buffer[Record::tagged_size()];
+    static MultiUnitSmartData_Batch<16, 1, 2, 3> batch;
+
+    record.setValue<UNITS>(UNITS);
+    record.serialize(buffer);
+    restored.deserialize(buffer);
+
+    MultiUnitSmartData_element<UNITS> last;
+    MultiUnitSmartData_element<1> first;
+    restored.deserialize(buffer, last, first);
+
+    unsigned int size = record.serialize_tagged(buffer);
+    restored.deserialize_tagged(buffer, size);
+
+    int sum = 0;
+    restored.for_each([&](auto & element) { sum += element.a; });
+
+    batch.append(buffer, 1);
+
+    return (sum == UNITS) && (last.a == UNITS) ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include "smartdata.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Unit size decoding benchmark: SmartData::Unit::value_size() (digital sizes through the Digital_Sizes table) against
+// the former nested-conditional/switch decoding, kept below as reference, on a mix of units as found in an AV message
+// stream (mostly SI scalars, some motion vectors and dynamics states, a few RFIDs, switches and JPEG frames).
+// Both must agree on every unit, including each Unit::Get<UNIT>::DIGITAL_LEN. Built with the EPOS system Traits, as smartdata.h.
+//
+// Usage: unit_size_benchmark [iterations]
+
+typedef SmartData::Unit Unit;
+
+static size_t legacy_digital_value_size(unsigned int unit)
+{
+    if((unit & Unit::SI))
+        return 0;
+
+    switch(unit >> 16) {
+    case Unit::MOTION_VECTOR_GLOBAL >> 16: return (unit & Unit::LEN) * ((3 * 8 + 4 * 4 + 3 * 4) + 2 * 4 + 8);
+    case Unit::MOTION_VECTOR_LOCAL >> 16: return (unit & Unit::LEN) * ((2 * 4 + 4 * 4 + 3 * 4) + 2 * 4 + 8);
+    case Unit::AV_DYNAMICS_STATE >> 16: return (unit & Unit::LEN) * (3 * 8 + 6 * 4 + 1);
+    case Unit::JPEG >> 16: return (unit & Unit::LEN) == 1 ? 61440 : unit & Unit::LEN;
+    case Unit::PCMU >> 16: case Unit::GSM >> 16: case Unit::G723 >> 16: case Unit::DVI4_8 >> 16: case Unit::DVI4_16 >> 16:
+    case Unit::LPC >> 16: case Unit::PCMA >> 16: case Unit::G722 >> 16: case Unit::L16_2 >> 16: case Unit::L16_1 >> 16:
+    case Unit::QCELP >> 16: case Unit::CN >> 16: case Unit::MPA >> 16: case Unit::G728 >> 16: case Unit::DVI4_11 >> 16:
+    case Unit::DVI4_22 >> 16: case Unit::G729 >> 16: case Unit::CelB >> 16: case Unit::nv >> 16: case Unit::H261 >> 16:
+    case Unit::MPV >> 16: case Unit::MP2T >> 16: case Unit::H263 >> 16: case Unit::H264 >> 16: case Unit::MPEG2TS >> 16:
+        return (unit & Unit::LEN) == 1 ? 1 : unit & Unit::LEN;
+    default: return unit & Unit::LEN;
+    }
+}
+
+static size_t legacy_value_size(unsigned int unit)
+{
+    return (unit & Unit::SI) && ((unit & Unit::NUM) == Unit::I32) ? sizeof(Int32)
+         : (unit & Unit::SI) && ((unit & Unit::NUM) == Unit::I64) ? sizeof(Int64)
+         : (unit & Unit::SI) && ((unit & Unit::NUM) == Unit::F32) ? sizeof(Float32)
+         : (unit & Unit::SI) && ((unit & Unit::NUM) == Unit::D64) ? sizeof(Float64)
+         : !(unit & Unit::SI) ? legacy_digital_value_size(unit) : 0;
+}
+
+template<unsigned int UNIT>
+static bool check() { return Unit::Get<UNIT>::DIGITAL_LEN == legacy_digital_value_size(UNIT); }
+
+static const unsigned int MIX[] = {
+    Unit::Length | Unit::D64, Unit::Speed | Unit::F32, Unit::Acceleration | Unit::F32, Unit::Temperature | Unit::I32,
+    Unit::Length | Unit::D64, Unit::Speed | Unit::F32, Unit::Angle | Unit::F32, Unit::Time | Unit::I64,
+    Unit::Length | Unit::D64, Unit::Speed | Unit::F32, Unit::Acceleration | Unit::F32, Unit::Current | Unit::I32,
+    Unit::MOTION_VECTOR_GLOBAL | 16, Unit::MOTION_VECTOR_LOCAL | 4, Unit::AV_DYNAMICS_STATE | 1, Unit::MOTION_VECTOR_GLOBAL | 1,
+    Unit::RFID32, Unit::Switch, Unit::Direction, Unit::JPEG | 1, Unit::H264 | 1024, Unit::PCMU | 1,
+    Unit::Voltage | Unit::F32, Unit::Luminous_Intensity | Unit::I32, Unit::Power | Unit::D64, Unit::Pressure | Unit::D64,
+    Unit::Ratio | Unit::F32, Unit::Percent | Unit::I32, Unit::Amount_of_Substance | Unit::I32, Unit::Frequency | Unit::F32,
+    Unit::MOTION_VECTOR_LOCAL | 32, Unit::AV_DYNAMICS_STATE | 8
+};
+static const unsigned int N = sizeof(MIX) / sizeof(MIX[0]);
+static const unsigned int STREAM = 4096;
+
+template<typename F>
+static double measure(const char * name, unsigned int iterations, F && f)
+{
+    // A stream of units drawn from the mix, so branches on the unit cannot simply be learned by the predictor
+    static unsigned int units[STREAM];
+    unsigned int seed = 1;
+    for(unsigned int i = 0; i < STREAM; i++) {
+        seed = seed * 1103515245 + 12345;
+        units[i] = MIX[(seed >> 16) % N];
+    }
+
+    volatile size_t sink = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < iterations; i++) {
+        size_t sum = 0;
+        for(unsigned int j = 0; j < STREAM; j++)
+            sum += f(units[j]);
+        sink = sink + sum;
+        asm volatile("" : : "r"(units) : "memory"); // keep the units opaque across iterations
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - begin).count() / (double(iterations) * STREAM);
+    printf("%-10s %6.3f ns/unit\n", name, ns);
+    return ns;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned int iterations = (argc > 1) ? atoi(argv[1]) : 10000;
+
+    for(unsigned int i = 0; i < N; i++)
+        if(Unit(MIX[i]).value_size() != legacy_value_size(MIX[i])) {
+            printf("value_size mismatch for unit %08x\n", MIX[i]);
+            return 1;
+        }
+    if(!(check<Unit::MOTION_VECTOR_GLOBAL | 3>() && check<Unit::MOTION_VECTOR_LOCAL | 1>() && check<Unit::AV_DYNAMICS_STATE | 2>()
+         && check<Unit::JPEG | 1>() && check<Unit::JPEG | 512>() && check<Unit::H264 | 1>() && check<Unit::RFID32>() && check<Unit::Switch>())) {
+        printf("DIGITAL_LEN mismatch\n");
+        return 1;
+    }
+
+    double legacy = measure("legacy", iterations, [](unsigned int u) { return legacy_value_size(u); });
+    double table = measure("table", iterations, [](unsigned int u) { return Unit(u).value_size(); });
+    printf("speedup    %6.2fx\n", legacy / table);
+
+    return 0;
+}
@@ -154,6 +154,98 @@ private:
     T _data[N_ELEMENTS];
 };
 
+// Lock-free Circular Buffer for exactly one producer and one consumer thread (e.g. a NIC receive thread feeding the
+// SmartData processing thread). Head and tail are free-running indices, masked into the buffer (so N_ELEMENTS must be a
+// power of two, and all of its slots are usable), each written only by its own side with release stores and read by
+// the other with acquire loads. They sit on cache lines of their own, next to each side's copy of the other's index,
+// which is only reloaded when the buffer looks full (to the producer) or empty (to the consumer).
+template<typename T, unsigned int N_ELEMENTS>
+class SPSC_Circular_Buffer
+{
+private:
+    static_assert(N_ELEMENTS && !(N_ELEMENTS & (N_ELEMENTS - 1)) && (N_ELEMENTS <= (1U << 31)), "SPSC_Circular_Buffer size must be a power of two");
+
+    static const unsigned int MASK = N_ELEMENTS - 1;
+    static const unsigned int CACHE_LINE = 64;
+
+public:
+    typedef T Object_Type;
+
+public:
+    SPSC_Circular_Buffer(): _tail(0), _head_cache(0), _head(0), _tail_cache(0) {}
+
+    static unsigned int capacity() { return N_ELEMENTS; }
+
+    // Approximate when called concurrently with the other side, but always within [0, N_ELEMENTS]: _head is read first,
+    // so _tail, read after it, cannot be behind it, and a _tail that moved on after a stale _head is clamped
+    unsigned int size() const {
+        unsigned int head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        unsigned int used = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE) - head;
+        return (used < N_ELEMENTS) ? used : N_ELEMENTS;
+    }
+    bool empty() const { return size() == 0; }
+    bool full() const { return size() == N_ELEMENTS; }
+
+    // Producer side
+
+    bool push(const Object_Type & o) { return push_n(&o, 1); }
+
+    // Inserts up to n objects, returning how many fit
+    unsigned int push_n(const Object_Type * o, unsigned int n) {
+        unsigned int tail = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+        unsigned int free = N_ELEMENTS - (tail - _head_cache);
+        if(free < n) {
+            _head_cache = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+            free = N_ELEMENTS - (tail - _head_cache);
+            if(free < n)
+                n = free;
+        }
+        unsigned int first = tail & MASK;
+        unsigned int k = (n < N_ELEMENTS - first) ? n : N_ELEMENTS - first;
+        for(unsigned int i = 0; i < k; i++)
+            _data[first + i] = o[i];
+        for(unsigned int i = k; i < n; i++)
+            _data[i - k] = o[i];
+        __atomic_store_n(&_tail, tail + n, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    // Consumer side
+
+    bool pop(Object_Type & o) { return pop_n(&o, 1); }
+
+    // Removes up to n objects, returning how many there were
+    unsigned int pop_n(Object_Type * o, unsigned int n) {
+        unsigned int head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+        unsigned int used = _tail_cache - head;
+        if(used < n) {
+            _tail_cache = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+            used = _tail_cache - head;
+            if(used < n)
+                n = used;
+        }
+        unsigned int first = head & MASK;
+        unsigned int k = (n < N_ELEMENTS - first) ? n : N_ELEMENTS - first;
+        for(unsigned int i = 0; i < k; i++)
+            o[i] = _data[first + i];
+        for(unsigned int i = k; i < n; i++)
+            o[i] = _data[i - k];
+        __atomic_store_n(&_head, head + n, __ATOMIC_RELEASE);
+        return n;
+    }
+
+private:
+    // Producer's line
+    alignas(CACHE_LINE) unsigned int _tail;
+    unsigned int _head_cache;
+
+    // Consumer's line
+    alignas(CACHE_LINE) unsigned int _head;
+    unsigned int _tail_cache;
+
+    alignas(CACHE_LINE) Object_Type _data[N_ELEMENTS];
+};
+
 // Circular Buffer
 template<typename T>
 class Dynamic_Circular_Buffer
@@ -4,6 +4,10 @@
 
 #include <utility/math.h>
 
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace Convert
 {
 template<typename T>
@@ -30,4 +34,270 @@ template<typename Hertz, typename Count, typename Time, typename Temporary = typ
 inline Time count2ms(const Hertz & frequency, const Count & count) { return (static_cast<Temporary>(count) / (frequency / 1000 )) ; }
 template<typename Hertz, typename Count, typename Time, typename Temporary = typename LARGER<Time>::Result>
 inline Time count2us(const Hertz & frequency, const Count & count) { return (static_cast<Temporary>(count) / (frequency / 1000000)); }
+
+// Affine conversion of n values (out = in * k + b), with scale and offset folded into a single multiply-add per value,
+// done in SIMD (AVX or SSE2, FMA when available) for the floating-point pairs. Values are computed in float only if both
+// sides are float, in double otherwise, and rounded to nearest if Out is an integer. All paths give the same results.
+inline float madd(float x, float k, float b)
+{
+#if defined(__FMA__)
+    return __builtin_fmaf(x, k, b);
+#else
+    return x * k + b;
+#endif
+}
+
+inline double madd(double x, double k, double b)
+{
+#if defined(__FMA__)
+    return __builtin_fma(x, k, b);
+#else
+    return x * k + b;
+#endif
+}
+
+template<typename Out>
+struct Round { template<typename T> static Out get(T v) { return static_cast<Out>(v); } };
+template<> struct Round<int> { template<typename T> static int get(T v) { return __builtin_lrint(v); } };
+template<> struct Round<long> { template<typename T> static long get(T v) { return __builtin_lrint(v); } };
+template<> struct Round<long long> { template<typename T> static long long get(T v) { return __builtin_llrint(v); } };
+
+template<typename In, typename Out>
+struct Affine
+{
+    typedef typename IF<EQUAL<In, float>::Result && EQUAL<Out, float>::Result, float, double>::Result Temporary;
+
+    static void run(Out * out, const In * in, unsigned long n, double k, double b, unsigned long i = 0) {
+        for(; i < n; i++)
+            out[i] = Round<Out>::get(madd(static_cast<Temporary>(in[i]), static_cast<Temporary>(k), static_cast<Temporary>(b)));
+    }
+};
+
+#if defined(__AVX__)
+inline __m256 madd(__m256 x, __m256 k, __m256 b)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(x, k, b);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(x, k), b);
+#endif
+}
+
+inline __m256d madd(__m256d x, __m256d k, __m256d b)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_pd(x, k, b);
+#else
+    return _mm256_add_pd(_mm256_mul_pd(x, k), b);
+#endif
+}
+#endif
+
+#if defined(__SSE2__)
+inline __m128 madd(__m128 x, __m128 k, __m128 b)
+{
+#if defined(__FMA__)
+    return _mm_fmadd_ps(x, k, b);
+#else
+    return _mm_add_ps(_mm_mul_ps(x, k), b);
+#endif
+}
+
+inline __m128d madd(__m128d x, __m128d k, __m128d b)
+{
+#if defined(__FMA__)
+    return _mm_fmadd_pd(x, k, b);
+#else
+    return _mm_add_pd(_mm_mul_pd(x, k), b);
+#endif
+}
+
+template<>
+inline void Affine<float, float>::run(float * out, const float * in, unsigned long n, double k, double b, unsigned long i)
+{
+#if defined(__AVX__)
+    const __m256 k8 = _mm256_set1_ps(k), b8 = _mm256_set1_ps(b);
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(&out[i], madd(_mm256_loadu_ps(&in[i]), k8, b8));
+#endif
+    const __m128 k4 = _mm_set1_ps(k), b4 = _mm_set1_ps(b);
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_ps(&out[i], madd(_mm_loadu_ps(&in[i]), k4, b4));
+    for(; i < n; i++)
+        out[i] = madd(in[i], static_cast<float>(k), static_cast<float>(b));
+}
+
+template<>
+inline void Affine<double, double>::run(double * out, const double * in, unsigned long n, double k, double b, unsigned long i)
+{
+#if defined(__AVX__)
+    const __m256d k4 = _mm256_set1_pd(k), b4 = _mm256_set1_pd(b);
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(&out[i], madd(_mm256_loadu_pd(&in[i]), k4, b4));
+#endif
+    const __m128d k2 = _mm_set1_pd(k), b2 = _mm_set1_pd(b);
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(&out[i], madd(_mm_loadu_pd(&in[i]), k2, b2));
+    for(; i < n; i++)
+        out[i] = madd(in[i], k, b);
+}
+
+template<>
+inline void Affine<float, double>::run(double * out, const float * in, unsigned long n, double k, double b, unsigned long i)
+{
+#if defined(__AVX__)
+    const __m256d k4 = _mm256_set1_pd(k), b4 = _mm256_set1_pd(b);
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(&out[i], madd(_mm256_cvtps_pd(_mm_loadu_ps(&in[i])), k4, b4));
+#endif
+    const __m128d k2 = _mm_set1_pd(k), b2 = _mm_set1_pd(b);
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(&out[i], madd(_mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(&in[i])))), k2, b2));
+    for(; i < n; i++)
+        out[i] = madd(static_cast<double>(in[i]), k, b);
+}
+
+template<>
+inline void Affine<double, float>::run(float * out, const double * in, unsigned long n, double k, double b, unsigned long i)
+{
+#if defined(__AVX__)
+    const __m256d k4 = _mm256_set1_pd(k), b4 = _mm256_set1_pd(b);
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_ps(&out[i], _mm256_cvtpd_ps(madd(_mm256_loadu_pd(&in[i]), k4, b4)));
+#endif
+    const __m128d k2 = _mm_set1_pd(k), b2 = _mm_set1_pd(b);
+    for(; i + 2 <= n; i += 2)
+        _mm_storel_pi(reinterpret_cast<__m64 *>(&out[i]), _mm_cvtpd_ps(madd(_mm_loadu_pd(&in[i]), k2, b2)));
+    for(; i < n; i++)
+        out[i] = madd(in[i], k, b);
+}
+#endif
+
+template<typename In, typename Out>
+inline void affine(Out * out, const In * in, unsigned long n, double k, double b = 0) { Affine<In, Out>::run(out, in, n, k, b); }
+
+// Rescaling of arrays of packed 3D integer points of 8, 16 or 32-bit coordinates, laid out as x, y, z and, if STRIDE is 4,
+// a padding coordinate (e.g. Space_Time::_Space<S>). Coordinates are multiplied by SCALE if it is positive, divided by
+// -SCALE (truncating) if it is negative, and then converted (wrapping) to Out, exactly as the scalar int arithmetic would.
+// rescale() handles groups of four points with SSE2 (dividing by reciprocal multiplication), zeroing any padding, and
+// returns how many points it converted, leaving the rest (at least the last point) to the caller.
+#if defined(__SSE2__)
+namespace Packed
+{
+// Four points as four vectors of 32-bit x, y, z and padding
+template<typename T, unsigned int STRIDE>
+struct Points;
+
+template<>
+struct Points<signed char, 4> {
+    static void load(__m128i * v, const signed char * p) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8), hi = _mm_srai_epi16(_mm_unpackhi_epi8(b, b), 8);
+        v[0] = _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16);
+        v[1] = _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16);
+        v[2] = _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16);
+        v[3] = _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16);
+    }
+
+    // Keeps the low byte of each coordinate, so packing does not saturate
+    static void store(signed char * p, const __m128i * v) {
+        const __m128i mask = _mm_setr_epi32(0xff, 0xff, 0xff, 0);
+        __m128i lo = _mm_packs_epi32(_mm_and_si128(v[0], mask), _mm_and_si128(v[1], mask));
+        __m128i hi = _mm_packs_epi32(_mm_and_si128(v[2], mask), _mm_and_si128(v[3], mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_packus_epi16(lo, hi));
+    }
+};
+
+template<>
+struct Points<short, 4> {
+    static void load(__m128i * v, const short * p) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 8));
+        v[0] = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+        v[1] = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+        v[2] = _mm_srai_epi32(_mm_unpacklo_epi16(b, b), 16);
+        v[3] = _mm_srai_epi32(_mm_unpackhi_epi16(b, b), 16);
+    }
+
+    // Sign-extends the low 16 bits of each coordinate, so packing does not saturate
+    static void store(short * p, const __m128i * v) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_packs_epi32(low(v[0]), low(v[1])));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 8), _mm_packs_epi32(low(v[2]), low(v[3])));
+    }
+
+    static __m128i low(__m128i v) {
+        const __m128i mask = _mm_setr_epi32(-1, -1, -1, 0);
+        return _mm_srai_epi32(_mm_slli_epi32(_mm_and_si128(v, mask), 16), 16);
+    }
+};
+
+// 12-byte points: the last load is shifted from 16-byte aligned bytes to stay within the four points, while each store
+// also writes 4 bytes over the next point, which is written afterwards (hence a fifth point must follow)
+template<>
+struct Points<int, 3> {
+    static void load(__m128i * v, const int * p) {
+        v[0] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        v[1] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 3));
+        v[2] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 6));
+        v[3] = _mm_srli_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 8)), 4);
+    }
+
+    static void store(int * p, const __m128i * v) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v[0]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 3), v[1]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 6), v[2]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 9), v[3]);
+    }
+};
+
+// Int8 is a char (signed on x86), and Int32 a long on 32-bit targets
+template<> struct Points<char, 4> {
+    static void load(__m128i * v, const char * p) { Points<signed char, 4>::load(v, reinterpret_cast<const signed char *>(p)); }
+    static void store(char * p, const __m128i * v) { Points<signed char, 4>::store(reinterpret_cast<signed char *>(p), v); }
+};
+template<> struct Points<long, 3> {
+    static void load(__m128i * v, const long * p) { Points<int, 3>::load(v, reinterpret_cast<const int *>(p)); }
+    static void store(long * p, const __m128i * v) { Points<int, 3>::store(reinterpret_cast<int *>(p), v); }
+};
+
+template<int SCALE>
+inline __m128i scale(__m128i v) { return v; }
+
+// x * 50 = x * 32 + x * 16 + x * 2
+template<>
+inline __m128i scale<50>(__m128i v) { return _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(v, 5), _mm_slli_epi32(v, 4)), _mm_slli_epi32(v, 1)); }
+
+// x / 50 = (x * 0x51eb851f) >> 36, plus 1 if x < 0 (as compilers do it). SSE2 only has unsigned 32x32 multiplies, so
+// the high word is taken unsigned and then corrected for negative x.
+template<>
+inline __m128i scale<-50>(__m128i v) {
+    const __m128i m = _mm_set1_epi32(0x51eb851f);
+    const __m128i high = _mm_setr_epi32(0, -1, 0, -1);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(v, m), 32);
+    __m128i odd = _mm_and_si128(_mm_mul_epu32(_mm_srli_epi64(v, 32), m), high);
+    __m128i sign = _mm_srai_epi32(v, 31);
+    __m128i h = _mm_sub_epi32(_mm_or_si128(even, odd), _mm_and_si128(sign, m));
+    return _mm_sub_epi32(_mm_srai_epi32(h, 4), sign);
+}
+}
+
+template<typename Out, unsigned int OUT_STRIDE, typename In, unsigned int IN_STRIDE, int SCALE>
+inline unsigned long rescale(Out * out, const In * in, unsigned long n)
+{
+    unsigned long i = 0;
+    for(; i + 5 <= n; i += 4) {
+        __m128i v[4];
+        Packed::Points<In, IN_STRIDE>::load(v, in + i * IN_STRIDE);
+        v[0] = Packed::scale<SCALE>(v[0]);
+        v[1] = Packed::scale<SCALE>(v[1]);
+        v[2] = Packed::scale<SCALE>(v[2]);
+        v[3] = Packed::scale<SCALE>(v[3]);
+        Packed::Points<Out, OUT_STRIDE>::store(out + i * OUT_STRIDE, v);
+    }
+    return i;
+}
+#else
+template<typename Out, unsigned int OUT_STRIDE, typename In, unsigned int IN_STRIDE, int SCALE>
+inline unsigned long rescale(Out *, const In *, unsigned long) { return 0; }
+#endif
 };
@@ -0,0 +1,160 @@
+#pragma once
+
+// EPOS Endianness Utility Declarations
+
+// Conversions between host and network (i.e. big-endian) byte order. Batch conversions byte-swap whole arrays of
+// WORD-byte values with SIMD shuffles when the CPU supports them (AVX2 or SSSE3, checked once at runtime unless the
+// target already implies them, or NEON), falling back to bswap.
+
+#include "../meta.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define __ENDIAN_X86
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace Endian
+{
+constexpr bool big() { return __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__; }
+
+inline unsigned char bswap(unsigned char v) { return v; }
+inline unsigned short bswap(unsigned short v) { return __builtin_bswap16(v); }
+inline unsigned int bswap(unsigned int v) { return __builtin_bswap32(v); }
+inline unsigned long long bswap(unsigned long long v) { return __builtin_bswap64(v); }
+
+// Reverses the bytes of any 1, 2, 4 or 8-byte type (including floating point)
+template<typename T>
+inline T swap(const T & v)
+{
+    typedef typename SWITCH<sizeof(T), CASE<1, unsigned char, CASE<2, unsigned short, CASE<4, unsigned int, CASE<8, unsigned long long>>>>>::Result Word;
+
+    Word w;
+    __builtin_memcpy(&w, &v, sizeof(T));
+    w = bswap(w);
+    T r;
+    __builtin_memcpy(&r, &w, sizeof(T));
+    return r;
+}
+
+template<typename T>
+inline T htobe(const T & v) { return big() ? v : swap(v); }
+template<typename T>
+inline T betoh(const T & v) { return big() ? v : swap(v); }
+
+namespace Shuffle
+{
+// Byte-swaps WORD-byte values from s[i] on while a whole vector is left, returning where it stopped
+#ifdef __ENDIAN_X86
+
+template<unsigned int WORD>
+__attribute__((target("ssse3")))
+inline unsigned long ssse3(unsigned char * d, const unsigned char * s, unsigned long i, unsigned long bytes)
+{
+    const __m128i mask = (WORD == 2) ? _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)
+                       : (WORD == 4) ? _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12)
+                       :               _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for(; i + 16 <= bytes; i += 16)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&d[i]), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&s[i])), mask));
+    return i;
+}
+
+template<unsigned int WORD>
+__attribute__((target("avx2")))
+inline unsigned long avx2(unsigned char * d, const unsigned char * s, unsigned long i, unsigned long bytes)
+{
+    const __m256i mask = (WORD == 2) ? _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)
+                       : (WORD == 4) ? _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12)
+                       :               _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for(; i + 32 <= bytes; i += 32)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&d[i]), _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(&s[i])), mask));
+    return i;
+}
+
+inline bool has_ssse3()
+{
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    return ssse3;
+}
+
+inline bool has_avx2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+#elif defined(__ARM_NEON)
+
+template<unsigned int WORD>
+inline unsigned long neon(unsigned char * d, const unsigned char * s, unsigned long i, unsigned long bytes)
+{
+    for(; i + 16 <= bytes; i += 16) {
+        uint8x16_t v = vld1q_u8(&s[i]);
+        v = (WORD == 2) ? vrev16q_u8(v) : (WORD == 4) ? vrev32q_u8(v) : vrev64q_u8(v);
+        vst1q_u8(&d[i], v);
+    }
+    return i;
+}
+
+#endif
+}
+
+// Byte-swaps n WORD-byte values from src to dst (which may be the same; neither must be aligned)
+template<unsigned int WORD>
+inline void swap(void * dst, const void * src, unsigned long n)
+{
+    unsigned char * d = reinterpret_cast<unsigned char *>(dst);
+    const unsigned char * s = reinterpret_cast<const unsigned char *>(src);
+    unsigned long bytes = n * WORD;
+    unsigned long i = 0;
+
+    if(WORD == 1) {
+        if(d != s)
+            __builtin_memmove(d, s, bytes);
+        return;
+    }
+
+#ifdef __ENDIAN_X86
+#if defined(__AVX2__)
+    static const bool avx2 = true;
+#else
+    bool avx2 = Shuffle::has_avx2();
+#endif
+#if defined(__SSSE3__)
+    static const bool ssse3 = true;
+#else
+    bool ssse3 = Shuffle::has_ssse3();
+#endif
+    if(avx2)
+        i = Shuffle::avx2<WORD>(d, s, i, bytes);
+    if(ssse3)
+        i = Shuffle::ssse3<WORD>(d, s, i, bytes);
+#elif defined(__ARM_NEON)
+    i = Shuffle::neon<WORD>(d, s, i, bytes);
+#endif
+
+    typedef typename SWITCH<WORD, CASE<1, unsigned char, CASE<2, unsigned short, CASE<4, unsigned int, CASE<8, unsigned long long>>>>>::Result Word;
+    for(; i < bytes; i += WORD) {
+        Word w;
+        __builtin_memcpy(&w, &s[i], WORD);
+        w = bswap(w);
+        __builtin_memcpy(&d[i], &w, WORD);
+    }
+}
+
+// Batch host <-> big-endian conversions of n WORD-byte values
+template<unsigned int WORD>
+inline void htobe(void * dst, const void * src, unsigned long n)
+{
+    if(big()) {
+        if(dst != src)
+            __builtin_memmove(dst, src, n * WORD);
+    } else
+        swap<WORD>(dst, src, n);
+}
+
+template<unsigned int WORD>
+inline void betoh(void * dst, const void * src, unsigned long n) { htobe<WORD>(dst, src, n); }
+}
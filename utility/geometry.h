@@ -8,6 +8,9 @@
 template<typename T, unsigned int dimensions>
 struct Point;
 
+template<typename T, unsigned int MAX_ANCHORS = 16>
+class Multilateration;
+
 template<typename T>
 struct Point<T, 2>
 {
@@ -18,6 +21,7 @@ private:
 public:
     using Number = T;
     using Distance = typename UNSIGNED<Larger_T>::Result;
+    using Squared_Distance = typename UNSIGNED<typename LARGER<Larger_T>::Result>::Result;
 
     Point() {}
     Point(const T & xi, const T & yi): _x(xi), _y(yi) {}
@@ -34,7 +38,17 @@ public:
         // Care for unsigned T
         Larger_T xx = p._x > _x ? p._x - _x : _x - p._x;
         Larger_T yy = p._y > _y ? p._y - _y : _y - p._y;
-        return Math::sqrt<Number>(xx * xx + yy * yy);
+        return Math::sqrt<unsigned long long>(static_cast<unsigned long long>(xx) * xx + static_cast<unsigned long long>(yy) * yy);
+    }
+
+    // Squared Euclidean distance, to compare distances without taking square roots; saturated, as for 32-bit T the sum
+    // of squares may not fit in Squared_Distance
+    template<typename P>
+    Squared_Distance squared_distance(const P & p) const {
+        Squared_Distance xx = p._x > _x ? static_cast<Larger_T>(p._x) - _x : static_cast<Larger_T>(_x) - p._x;
+        Squared_Distance yy = p._y > _y ? static_cast<Larger_T>(p._y) - _y : static_cast<Larger_T>(_y) - p._y;
+        Squared_Distance d;
+        return __builtin_add_overflow(xx * xx, yy * yy, &d) ? ~static_cast<Squared_Distance>(0) : d;
     }
 
     // Translation
@@ -107,6 +121,7 @@ private:
 public:
     using Number = T;
     using Distance = typename UNSIGNED<Larger_T>::Result;
+    using Squared_Distance = typename UNSIGNED<typename LARGER<Larger_T>::Result>::Result; // saturates for Int32 beyond 2^64 - 1
 
     Point() {}
     Point(const T & xi, const T & yi, const T & zi): _x(xi), _y(yi), _z(zi) {}
@@ -125,7 +140,34 @@ public:
         Distance xx = p._x > _x ? p._x - _x : _x - p._x;
         Distance yy = p._y > _y ? p._y - _y : _y - p._y;
         Distance zz = p._z > _z ? p._z - _z : _z - p._z;
-        return Math::sqrt<Number>(xx * xx + yy * yy + zz * zz);
+        return Math::sqrt<unsigned long long>(static_cast<unsigned long long>(xx) * xx + static_cast<unsigned long long>(yy) * yy + static_cast<unsigned long long>(zz) * zz);
+    }
+
+    // Squared Euclidean distance, to compare distances without taking square roots; saturated, as for 32-bit T the sum
+    // of squares may not fit in Squared_Distance
+    template<typename P>
+    Squared_Distance squared_distance(const P & p) const {
+        Squared_Distance xx = p._x > _x ? static_cast<Larger_T>(p._x) - _x : static_cast<Larger_T>(_x) - p._x;
+        Squared_Distance yy = p._y > _y ? static_cast<Larger_T>(p._y) - _y : static_cast<Larger_T>(_y) - p._y;
+        Squared_Distance zz = p._z > _z ? static_cast<Larger_T>(p._z) - _z : static_cast<Larger_T>(_z) - p._z;
+        Squared_Distance d;
+        if(__builtin_add_overflow(xx * xx, yy * yy, &d) || __builtin_add_overflow(d, zz * zz, &d))
+            return ~static_cast<Squared_Distance>(0);
+        return d;
+    }
+
+    // Index of the nearest of n points (the first of those tied), or n if there are none
+    unsigned int nearest(const Point * points, unsigned int n) const {
+        unsigned int best = n;
+        Squared_Distance d = 0;
+        for(unsigned int i = 0; i < n; i++) {
+            Squared_Distance e = squared_distance(points[i]);
+            if((best == n) || (e < d)) {
+                best = i;
+                d = e;
+            }
+        }
+        return best;
     }
 
     // Translation
@@ -149,46 +191,317 @@ public:
         return ret += p;
     }
 
-    // TODO: 3D trilateration
+    // Point at distances d1, d2 and d3 from p1, p2 and p3, on the side of their plane (p2 - p1) x (p3 - p1) points to
+    // (see Multilateration for more anchors)
     static Point trilaterate(const Point & p1, const Distance & d1,  const Point & p2, const Distance & d2, const Point & p3, const Distance & d3) {
-        Larger_T a[2][3];
+        const Point p[3] = { p1, p2, p3 };
+        const Distance d[3] = { d1, d2, d3 };
+        Multilateration<T, 3> m(p, 3);
+        return m.valid() ? m.solve(d) : Point(0, 0, 0);
+    }
 
-        a[0][0] = 2 * (-p1._x + p3._x);
-        a[0][1] = 2 * (-p1._y + p3._y);
-        a[0][2] = 1 * ((d1 * d1 - (p1._x * p1._x + p1._y * p1._y)) - (d3 * d3 - (p3._x * p3._x + p3._y * p3._y)));
+    friend OStream & operator<<(OStream & os, const Point & c) {
+        os << "(" << static_cast<Print_Type>(c._x) << "," << static_cast<Print_Type>(c._y) << "," << static_cast<Print_Type>(c._z) << ")";
+        return os;
+    }
 
-        a[1][0] = 2 * (-p2._x + p3._x);
-        a[1][1] = 2 * (-p2._y + p3._y);
-        a[1][2] = 1 * ((d2 * d2 - (p2._x * p2._x + p2._y * p2._y))-(d3 * d3 - (p3._x * p3._x + p3._y * p3._y)));
+    T _x, _y, _z;
+}__attribute__((packed));
 
-        if(a[0][0] != 0) {
-            a[1][1] -= a[0][1] * a[1][0] / a[0][0];
-            a[1][2] -= a[0][2] * a[1][0] / a[0][0];
-            a[1][0] = 0;
+// Least-squares position of a node from its (noisy) distances to n anchors at known positions (multilateration).
+// The system linearized by differencing squared ranges is solved in closed form for an initial guess, which a few
+// Gauss-Newton steps on the ranges themselves then refine. All that depends only on the anchors (their positions
+// relative to the centroid, kept as separate x, y and z arrays, and the inverse of the linear system) is computed once,
+// so each node of a ranging round costs O(n) per iteration and no allocation.
+// Coplanar anchors (e.g. all on the ceiling) leave a mirror ambiguity across their plane, solved by placing nodes on
+// the side of "side" or, if not given, on the side (a1 - a0) x (aj - a0) points to (aj the anchor making it largest).
+template<typename T, unsigned int MAX_ANCHORS>
+class Multilateration
+{
+public:
+    typedef Point<T, 3> Position;
+    typedef typename Position::Distance Distance;
+
+    static const unsigned int ITERATIONS = 3;
+
+private:
+    static constexpr double PLANAR = 1e-3;      // smallest over largest spread of the anchors below which they are taken as coplanar
+    static constexpr double CONVERGED = 1e-2;   // squared Gauss-Newton step (in units of T) under which iteration stops
+    static constexpr double HEIGHT = 0.1;       // least initial height over coplanar anchors, relative to their spread
+
+public:
+    Multilateration(): _n(0), _valid(false) {}
+    Multilateration(const Position * anchors, unsigned int n) { anchor(anchors, n, 0); }
+    Multilateration(const Position * anchors, unsigned int n, const Position & side) { anchor(anchors, n, &side); }
+
+    // Sets the anchors; false if they are fewer than three, more than MAX_ANCHORS, or collinear
+    bool anchor(const Position * anchors, unsigned int n, const Position * side = 0) {
+        _n = n;
+        _valid = false;
+        if((n < 3) || (n > MAX_ANCHORS))
+            return false;
+
+        _cx = _cy = _cz = 0;
+        for(unsigned int i = 0; i < n; i++) {
+            _cx += anchors[i].x();
+            _cy += anchors[i].y();
+            _cz += anchors[i].z();
+        }
+        _cx /= n;
+        _cy /= n;
+        _cz /= n;
+
+        double m[3][3] = {};
+        for(unsigned int i = 0; i < n; i++) {
+            _x[i] = anchors[i].x() - _cx;
+            _y[i] = anchors[i].y() - _cy;
+            _z[i] = anchors[i].z() - _cz;
+            _k[i] = _x[i] * _x[i] + _y[i] * _y[i] + _z[i] * _z[i];
+            m[0][0] += _x[i] * _x[i];
+            m[0][1] += _x[i] * _y[i];
+            m[0][2] += _x[i] * _z[i];
+            m[1][1] += _y[i] * _y[i];
+            m[1][2] += _y[i] * _z[i];
+            m[2][2] += _z[i] * _z[i];
+        }
+        m[1][0] = m[0][1];
+        m[2][0] = m[0][2];
+        m[2][1] = m[1][2];
+
+        // With eigenvalues l1 >= l2 >= l3 of m, trace(m) ~ l1, trace(adj(m)) ~ l1 * l2 and det(m) = l1 * l2 * l3
+        double a[3][3];
+        double det = adjugate(m, a);
+        double t = m[0][0] + m[1][1] + m[2][2];
+        _spread = t / n;
+        double ta = a[0][0] + a[1][1] + a[2][2];
+        if(!(ta > 1e-12 * t * t))
+            return false;
+        _planar = det <= PLANAR * PLANAR * t * ta;
+
+        if(!_planar) {
+            for(unsigned int i = 0; i < 3; i++)
+                for(unsigned int j = 0; j < 3; j++)
+                    _g[i][j] = -0.5 * a[i][j] / det;
+        } else {
+            // The normal is the eigenvector of l3, along which all rows of adj(m) ~ l1 * l2 * n * n' lie
+            unsigned int r = 0;
+            double best = 0;
+            for(unsigned int i = 0; i < 3; i++) {
+                double l = a[i][0] * a[i][0] + a[i][1] * a[i][1] + a[i][2] * a[i][2];
+                if(l > best) {
+                    best = l;
+                    r = i;
+                }
+            }
+            double l = Math::sqrt(best);
+            _nx = a[r][0] / l;
+            _ny = a[r][1] / l;
+            _nz = a[r][2] / l;
+
+            double ox, oy, oz;
+            if(side) {
+                ox = side->x() - _cx;
+                oy = side->y() - _cy;
+                oz = side->z() - _cz;
+            } else {
+                ox = oy = oz = 0;
+                double most = -1;
+                double ux = _x[1] - _x[0], uy = _y[1] - _y[0], uz = _z[1] - _z[0];
+                for(unsigned int j = 2; j < n; j++) {
+                    double vx = _x[j] - _x[0], vy = _y[j] - _y[0], vz = _z[j] - _z[0];
+                    double cx = uy * vz - uz * vy, cy = uz * vx - ux * vz, cz = ux * vy - uy * vx;
+                    double c = cx * cx + cy * cy + cz * cz;
+                    if(c > most) {
+                        most = c;
+                        ox = cx;
+                        oy = cy;
+                        oz = cz;
+                    }
+                }
+            }
+            if(ox * _nx + oy * _ny + oz * _nz < 0) {
+                _nx = -_nx;
+                _ny = -_ny;
+                _nz = -_nz;
+            }
+
+            // Pseudo-inverse in the plane: m + t * n * n' is well conditioned, and projecting its inverse drops n
+            double n[3] = { _nx, _ny, _nz };
+            for(unsigned int i = 0; i < 3; i++)
+                for(unsigned int j = 0; j < 3; j++)
+                    m[i][j] += t * n[i] * n[j];
+            det = adjugate(m, a);
+            for(unsigned int j = 0; j < 3; j++) {
+                double p = n[0] * a[0][j] + n[1] * a[1][j] + n[2] * a[2][j];
+                for(unsigned int i = 0; i < 3; i++)
+                    _g[i][j] = -0.5 * (a[i][j] - n[i] * p) / det;
+            }
         }
 
-        T _x, _y;
+        _valid = true;
+        return true;
+    }
 
-        if(a[1][1] == 0)
-            _y = 0;
-        else
-            _y = a[1][2] / a[1][1];
+    bool valid() const { return _valid; }
+    unsigned int anchors() const { return _n; }
+
+    // Position from the distances to each anchor
+    Position solve(const Distance * d, unsigned int iterations = ITERATIONS) const {
+        double dd[MAX_ANCHORS];
+        double vx = 0, vy = 0, vz = 0, md = 0;
+        for(unsigned int i = 0; i < _n; i++) {
+            dd[i] = d[i];
+            double b = dd[i] * dd[i] - _k[i];
+            vx += _x[i] * b;
+            vy += _y[i] * b;
+            vz += _z[i] * b;
+            md += dd[i] * dd[i];
+        }
 
-        if(a[0][0] == 0)
-            _x = 0;
-        else
-            _x = (a[0][2] - (_y * a[0][1])) / a[0][0];
+        double x = _g[0][0] * vx + _g[0][1] * vy + _g[0][2] * vz;
+        double y = _g[1][0] * vx + _g[1][1] * vy + _g[1][2] * vz;
+        double z = _g[2][0] * vx + _g[2][1] * vy + _g[2][2] * vz;
+
+        if(_planar) {
+            // Height over the plane from what is left of the ranges, kept off the plane, where Gauss-Newton cannot
+            // tell the sides apart
+            double r = 0;
+            for(unsigned int i = 0; i < _n; i++)
+                r += (x - _x[i]) * (x - _x[i]) + (y - _y[i]) * (y - _y[i]) + (z - _z[i]) * (z - _z[i]);
+            double h = Math::sqrt(Math::max((md - r) / _n, HEIGHT * HEIGHT * _spread));
+            x += h * _nx;
+            y += h * _ny;
+            z += h * _nz;
+        }
+
+        double px = x, py = y, pz = z, sx = 0, sy = 0, sz = 0, last = -1;
+        for(unsigned int k = 0; ; k++) {
+            double j[3][3] = {}, gx = 0, gy = 0, gz = 0, cost = 0;
+            for(unsigned int i = 0; i < _n; i++) {
+                double ux = x - _x[i], uy = y - _y[i], uz = z - _z[i];
+                double r = Math::sqrt(ux * ux + uy * uy + uz * uz);
+                double e = r - dd[i];
+                cost += e * e;
+                if(r == 0)
+                    continue;
+                ux /= r;
+                uy /= r;
+                uz /= r;
+                j[0][0] += ux * ux;
+                j[0][1] += ux * uy;
+                j[0][2] += ux * uz;
+                j[1][1] += uy * uy;
+                j[1][2] += uy * uz;
+                j[2][2] += uz * uz;
+                gx += ux * e;
+                gy += uy * e;
+                gz += uz * e;
+            }
+
+            if((last >= 0) && (cost > last)) {
+                // Overshot: back off halfway, or keep the previous point when out of iterations
+                sx *= 0.5;
+                sy *= 0.5;
+                sz *= 0.5;
+                x = px + sx;
+                y = py + sy;
+                z = pz + sz;
+                if(k < iterations)
+                    continue;
+                x = px;
+                y = py;
+                z = pz;
+                break;
+            }
+            if(k >= iterations)
+                break;
+            last = cost;
+            px = x;
+            py = y;
+            pz = z;
+
+            j[1][0] = j[0][1];
+            j[2][0] = j[0][2];
+            j[2][1] = j[1][2];
+            double a[3][3];
+            double det = adjugate(j, a);
+            double t = j[0][0] + j[1][1] + j[2][2];
+            if(!(det > 1e-12 * t * t * t))
+                break;
+            sx = -(a[0][0] * gx + a[0][1] * gy + a[0][2] * gz) / det;
+            sy = -(a[1][0] * gx + a[1][1] * gy + a[1][2] * gz) / det;
+            sz = -(a[2][0] * gx + a[2][1] * gy + a[2][2] * gz) / det;
+            x += sx;
+            y += sy;
+            z += sz;
+            if(sx * sx + sy * sy + sz * sz < CONVERGED)
+                break;
+        }
 
-        return Point(_x, _y, 0);
+        if(_planar) {
+            // Both sides fit coplanar anchors equally well
+            double h = x * _nx + y * _ny + z * _nz;
+            if(h < 0) {
+                x -= 2 * h * _nx;
+                y -= 2 * h * _ny;
+                z -= 2 * h * _nz;
+            }
+        }
+
+        return Position(round(x + _cx), round(y + _cy), round(z + _cz));
     }
 
-    friend OStream & operator<<(OStream & os, const Point & c) {
-        os << "(" << static_cast<Print_Type>(c._x) << "," << static_cast<Print_Type>(c._y) << "," << static_cast<Print_Type>(c._z) << ")";
-        return os;
+    // Positions of nodes sharing these anchors, from rows of anchors() distances
+    void solve(Position * p, const Distance * d, unsigned int nodes, unsigned int iterations = ITERATIONS) const {
+        for(unsigned int i = 0; i < nodes; i++)
+            p[i] = solve(d + i * _n, iterations);
     }
 
-    T _x, _y, _z;
-}__attribute__((packed));
+    // Positions of nodes each with anchors of its own, from rows of n anchors and n distances; false if the anchors of
+    // any node were degenerate (and the node was placed at the origin)
+    static bool solve(Position * p, const Position * anchors, const Distance * d, unsigned int n, unsigned int nodes, unsigned int iterations = ITERATIONS) {
+        bool ok = true;
+        for(unsigned int i = 0; i < nodes; i++) {
+            Multilateration m(anchors + i * n, n);
+            if(m.valid())
+                p[i] = m.solve(d + i * n, iterations);
+            else {
+                p[i] = Position(0, 0, 0);
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+private:
+    static double adjugate(const double m[3][3], double a[3][3]) {
+        a[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        a[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+        a[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+        a[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        a[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+        a[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+        a[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        a[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+        a[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+        return m[0][0] * a[0][0] + m[0][1] * a[1][0] + m[0][2] * a[2][0];
+    }
+
+    static T round(double v) { return static_cast<T>(v < 0 ? v - 0.5 : v + 0.5); }
+
+private:
+    double _x[MAX_ANCHORS];
+    double _y[MAX_ANCHORS];
+    double _z[MAX_ANCHORS];
+    double _k[MAX_ANCHORS]; // squared norms
+    double _g[3][3];        // maps sum(a_i * (d_i^2 - k_i)) to the linearized solution
+    double _cx, _cy, _cz;   // centroid
+    double _spread;         // mean squared distance to the centroid
+    double _nx, _ny, _nz;   // normal, toward the side nodes are placed on, if _planar
+    unsigned int _n;
+    bool _planar;
+    bool _valid;
+};
 
 template<typename T1, typename T2 = void>
 struct Sphere
@@ -207,13 +520,123 @@ public:
     Center center() const { return _c; }
     Radius radius() const { return _r; }
 
-    bool contains(const Center & c) const { return (_c - c) <= _r; }
+    bool contains(const Center & c) const { return inside(c, squared_radius()); }
+
+    // Sets bit i % 32 of mask[i / 32] if the sphere contains c[i] (and clears it otherwise), for n points
+    void contains(const Center * c, unsigned long n, unsigned int * mask) const {
+        typename Center::Squared_Distance r = squared_radius();
+        for(unsigned long i = 0; i < n; i += 32) {
+            unsigned int m = (n - i < 32) ? n - i : 32;
+            unsigned int w = 0;
+            unsigned int j = 0;
+#if defined(__SSE2__)
+            if(VECTOR && (r != SATURATED))
+                for(; j + 4 <= m; j += 4)
+                    w |= contains4(reinterpret_cast<const int *>(c + i + j), r) << j;
+#endif
+            for(; j < m; j++)
+                w |= static_cast<unsigned int>(inside(c[i + j], r)) << j;
+            mask[i / 32] = w;
+        }
+    }
 
     friend OStream & operator<<(OStream & os, const Sphere & s) {
         os << "{" << "c=" << s._c << ",r=" << static_cast<Print_Type>(s._r) << "}";
         return os;
     }
 
+private:
+    static const typename Center::Squared_Distance SATURATED = ~static_cast<typename Center::Squared_Distance>(0);
+
+    // Saturated like Point::squared_distance()
+    typename Center::Squared_Distance squared_radius() const {
+        typedef typename Center::Squared_Distance Squared;
+        const Squared limit = SATURATED >> (sizeof(Squared) * 4);
+        return (_r > limit) ? SATURATED : static_cast<Squared>(_r) * _r;
+    }
+
+    // A saturated squared distance is beyond any squared radius that is not, but only the exact figures decide between
+    // two saturated ones (which only happens for 32-bit coordinates and radii of 2^32 or more)
+    bool inside(const Center & c, typename Center::Squared_Distance r) const {
+        typename Center::Squared_Distance d = _c.squared_distance(c);
+        return (d < r) || ((d == r) && ((r != SATURATED) || wide(c)));
+    }
+
+    // The squared distance (of up to 66 bits) against the squared radius (of up to 128), as high and low 64-bit words
+    bool wide(const Center & c) const {
+        const unsigned long long d[3] = { axis(c.x(), _c.x()), axis(c.y(), _c.y()), axis(c.z(), _c.z()) };
+        unsigned long long hi = 0, lo = 0;
+        for(unsigned int i = 0; i < 3; i++) {
+            unsigned long long s = d[i] * d[i];
+            lo += s;
+            hi += (lo < s);
+        }
+
+        // r^2 = h^2 * 2^64 + 2 * h * l * 2^32 + l^2, for r = h * 2^32 + l
+        unsigned long long r = _r, h = r >> 32, l = r & 0xffffffff, m = h * l;
+        unsigned long long rhi = h * h + (m >> 31), rlo = l * l + (m << 33);
+        rhi += (rlo < (m << 33));
+        return (hi < rhi) || ((hi == rhi) && (lo <= rlo));
+    }
+
+    static unsigned long long axis(Number a, Number b) {
+        return (a > b) ? static_cast<unsigned long long>(static_cast<long long>(a) - b) : static_cast<unsigned long long>(static_cast<long long>(b) - a);
+    }
+
+    // Packed Int32 centers (Int32 is a long on 32-bit targets) go through SSE2 four at a time
+    static const bool VECTOR = (sizeof(Number) == 4) && (static_cast<Number>(-1) < 0) && (sizeof(Center) == 12);
+
+#if defined(__SSE2__)
+    // Containment bits of the four points p[0..11], in exactly the arithmetic of Point::squared_distance(): the
+    // absolute difference of each coordinate, as an unsigned int, squared to 64 bits and summed with saturation (so
+    // only for unsaturated r, as inside() takes the exact figures otherwise).
+    // The points are processed as loaded (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3), against the center likewise laid out.
+    unsigned int contains4(const int * p, unsigned long long r) const {
+        const int x = _c.x(), y = _c.y(), z = _c.z();
+        __m128i a = difference(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), _mm_setr_epi32(x, y, z, x));
+        __m128i b = difference(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 4)), _mm_setr_epi32(y, z, x, y));
+        __m128i c = difference(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 8)), _mm_setr_epi32(z, x, y, z));
+
+        // Squares of the even (x0 z0 | y1 x2 | z2 y3) and odd (y0 x1 | z1 y2 | x3 z3) lanes
+        __m128i ae = _mm_mul_epu32(a, a), ao = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(a, 32));
+        __m128i be = _mm_mul_epu32(b, b), bo = _mm_mul_epu32(_mm_srli_epi64(b, 32), _mm_srli_epi64(b, 32));
+        __m128i ce = _mm_mul_epu32(c, c), co = _mm_mul_epu32(_mm_srli_epi64(c, 32), _mm_srli_epi64(c, 32));
+
+        __m128i d01 = add(add(pick(ae, ao, 2), _mm_unpacklo_epi64(ao, be)), pick(ae, bo, 1));
+        __m128i d23 = add(add(pick(be, co, 1), _mm_unpackhi_epi64(bo, ce)), pick(ce, co, 2));
+
+        __m128i limit = _mm_set1_epi64x(r);
+        __m128 outside = _mm_shuffle_ps(_mm_castsi128_ps(greater(d01, limit)), _mm_castsi128_ps(greater(d23, limit)), _MM_SHUFFLE(3, 1, 3, 1));
+        return ~_mm_movemask_ps(outside) & 0xf;
+    }
+
+    // |p - c| of each lane, as an unsigned int
+    static __m128i difference(__m128i p, __m128i c) {
+        __m128i gt = _mm_cmpgt_epi32(p, c);
+        return _mm_or_si128(_mm_and_si128(gt, _mm_sub_epi32(p, c)), _mm_andnot_si128(gt, _mm_sub_epi32(c, p)));
+    }
+
+    // 64-bit lanes (a[imm & 1], b[imm >> 1])
+    static __m128i pick(__m128i a, __m128i b, int imm) {
+        return (imm == 1) ? _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b), 1))
+                          : _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b), 2));
+    }
+
+    // Unsigned 64-bit a + b, saturated: the sum wrapped if a > a + b
+    static __m128i add(__m128i a, __m128i b) {
+        __m128i s = _mm_add_epi64(a, b);
+        return _mm_or_si128(s, _mm_shuffle_epi32(greater(a, s), _MM_SHUFFLE(3, 3, 1, 1)));
+    }
+
+    // Unsigned 64-bit a > b (SSE2 has no 64-bit compares), valid in the high half of each lane
+    static __m128i greater(__m128i a, __m128i b) {
+        const __m128i bias = _mm_set1_epi32(0x80000000);
+        __m128i gt = _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+        __m128i eq = _mm_cmpeq_epi32(a, b);
+        return _mm_or_si128(gt, _mm_and_si128(eq, _mm_slli_epi64(gt, 32)));
+    }
+#endif
+
 private:
     Center _c;
     Radius _r;
@@ -0,0 +1,229 @@
+#pragma once
+
+// EPOS Morton (Z-Order) Key Utility Declarations
+
+#include "geometry.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// Morton keys interleave the bits of the three coordinates of a point (x in key bit 0, y in bit 1, z in bit 2, x in
+// bit 3, and so on), so points close in space are mostly close in key order, and every cube aligned to a power of two
+// is a single interval of keys. Signed coordinates have their sign bit flipped so that key order follows theirs.
+// Coordinates of up to 16 bits give 48-bit keys; 32-bit ones give 96-bit keys, kept as two 48-bit halves (Morton_Key).
+// Bits are spread with BMI2 pdep/pext when the target has them, and otherwise with a byte table (encoding) and shifts
+// and masks (decoding).
+
+struct Morton_Key
+{
+    static const unsigned long long HALF = (1ULL << 48) - 1;
+
+    bool operator==(const Morton_Key & k) const { return (high == k.high) && (low == k.low); }
+    bool operator!=(const Morton_Key & k) const { return !(*this == k); }
+    bool operator<(const Morton_Key & k) const { return (high < k.high) || ((high == k.high) && (low < k.low)); }
+    bool operator<=(const Morton_Key & k) const { return !(k < *this); }
+    bool operator>(const Morton_Key & k) const { return k < *this; }
+    bool operator>=(const Morton_Key & k) const { return !(*this < k); }
+
+    unsigned long long high; // bits 95..48
+    unsigned long long low;  // bits 47..0
+};
+
+template<typename T>
+class Morton
+{
+private:
+    typedef typename UNSIGNED<T>::Result Unsigned;
+
+    static const unsigned int BITS = sizeof(T) * 8;
+    static const bool WIDE = BITS > 16;
+    static_assert(BITS <= 32, "Morton keys are only defined for coordinates of up to 32 bits");
+
+    static const unsigned long long MASK = 0x249249249249ULL; // every third bit of 48
+
+public:
+    typedef typename IF<WIDE, Morton_Key, unsigned long long>::Result Key;
+    typedef Point<T, 3> Position;
+
+    // Keys first to last, inclusive
+    struct Range {
+        Key first;
+        Key last;
+    };
+
+    static const unsigned int DEPTH = 4;
+
+public:
+    static Key encode(const Position & p) { return encode(bias(p.x()), bias(p.y()), bias(p.z())); }
+
+    static Position decode(const Key & k) {
+        unsigned int x, y, z;
+        decode(k, x, y, z);
+        return Position(unbias(x), unbias(y), unbias(z));
+    }
+
+    // Intervals of keys covering the box with corners lo and hi (inclusive), in increasing order; returns how many (at
+    // most max, and at least one if max is not zero). The smallest aligned cube holding the box is split into octants,
+    // and those inside the box (or still crossing its border at the bottom level) are taken whole. The bottom level is
+    // depth levels below that of the cubes the box spans at most two of on each axis, and moves up while more than max
+    // intervals are needed. Intervals may thus also cover some points outside the box, which callers filter out.
+    static unsigned int ranges(Range * out, unsigned int max, const Position & lo, const Position & hi, unsigned int depth = DEPTH) {
+        if(!max)
+            return 0;
+
+        Box b;
+        b.lo[0] = bias(Math::min(lo.x(), hi.x()));
+        b.lo[1] = bias(Math::min(lo.y(), hi.y()));
+        b.lo[2] = bias(Math::min(lo.z(), hi.z()));
+        b.hi[0] = bias(Math::max(lo.x(), hi.x()));
+        b.hi[1] = bias(Math::max(lo.y(), hi.y()));
+        b.hi[2] = bias(Math::max(lo.z(), hi.z()));
+
+        unsigned int level = 0;
+        while((level < BITS) && (((b.lo[0] ^ b.hi[0]) >> level) || ((b.lo[1] ^ b.hi[1]) >> level) || ((b.lo[2] ^ b.hi[2]) >> level)))
+            level++;
+        unsigned long long root[3];
+        for(unsigned int i = 0; i < 3; i++)
+            root[i] = (static_cast<unsigned long long>(b.lo[i]) >> level) << level;
+
+        unsigned int span = 0;
+        while(((b.hi[0] >> span) - (b.lo[0] >> span) > 1) || ((b.hi[1] >> span) - (b.lo[1] >> span) > 1) || ((b.hi[2] >> span) - (b.lo[2] >> span) > 1))
+            span++;
+
+        for(unsigned int bottom = (span > depth) ? span - depth : 0; ; bottom++) {
+            unsigned int n = 0;
+            if(split(out, n, max, b, root, level, bottom) || (bottom >= level))
+                return n;
+        }
+    }
+
+private:
+    struct Box {
+        unsigned int lo[3];
+        unsigned int hi[3];
+    };
+
+    static unsigned int bias(T v) { return static_cast<Unsigned>(static_cast<Unsigned>(v) ^ (static_cast<Unsigned>(1) << (BITS - 1))); }
+    static T unbias(unsigned int u) { return static_cast<T>(static_cast<Unsigned>(u ^ (1U << (BITS - 1)))); }
+
+    // False if the cube of 2^level at c needs more than max intervals
+    static bool split(Range * out, unsigned int & n, unsigned int max, const Box & b, const unsigned long long * c, unsigned int level, unsigned int bottom) {
+        unsigned long long last[3];
+        bool inside = true;
+        for(unsigned int i = 0; i < 3; i++) {
+            last[i] = c[i] + (1ULL << level) - 1;
+            if((c[i] > b.hi[i]) || (last[i] < b.lo[i]))
+                return true;
+            inside = inside && (c[i] >= b.lo[i]) && (last[i] <= b.hi[i]);
+        }
+
+        if(inside || (level <= bottom)) {
+            Key first = encode(c[0], c[1], c[2]);
+            if(n && (successor(out[n - 1].last) == first)) {
+                out[n - 1].last = encode(last[0], last[1], last[2]);
+                return true;
+            }
+            if(n == max)
+                return false;
+            out[n].first = first;
+            out[n].last = encode(last[0], last[1], last[2]);
+            n++;
+            return true;
+        }
+
+        // Octants in key order
+        unsigned long long h = 1ULL << (level - 1);
+        for(unsigned int o = 0; o < 8; o++) {
+            unsigned long long d[3] = { c[0] + ((o & 1) ? h : 0), c[1] + ((o & 2) ? h : 0), c[2] + ((o & 4) ? h : 0) };
+            if(!split(out, n, max, b, d, level - 1, bottom))
+                return false;
+        }
+        return true;
+    }
+
+    // 16 bits of each coordinate to and from 48 bits of key
+
+    static unsigned long long interleave(unsigned int x, unsigned int y, unsigned int z) {
+#if defined(__BMI2__)
+        return _pdep_u64(x, MASK) | _pdep_u64(y, MASK << 1) | _pdep_u64(z, MASK << 2);
+#else
+        return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+#endif
+    }
+
+    static void deinterleave(unsigned long long k, unsigned int & x, unsigned int & y, unsigned int & z) {
+#if defined(__BMI2__)
+        x = _pext_u64(k, MASK);
+        y = _pext_u64(k, MASK << 1);
+        z = _pext_u64(k, MASK << 2);
+#else
+        x = compact(k);
+        y = compact(k >> 1);
+        z = compact(k >> 2);
+#endif
+    }
+
+    static unsigned long long spread(unsigned int v) {
+        return static_cast<unsigned long long>(Table::SPREAD.value[v & 0xff]) | (static_cast<unsigned long long>(Table::SPREAD.value[(v >> 8) & 0xff]) << 24);
+    }
+
+    static unsigned int compact(unsigned long long k) {
+        k &= MASK;
+        k = (k ^ (k >> 2)) & 0x0c30c30c30c3ULL;
+        k = (k ^ (k >> 4)) & 0x00f00f00f00fULL;
+        k = (k ^ (k >> 8)) & 0x0000ff0000ffULL;
+        k = (k ^ (k >> 16)) & 0x00000000ffffULL;
+        return k;
+    }
+
+    struct Table {
+        struct Spread {
+            constexpr Spread(): value{} {
+                for(unsigned int i = 0; i < 256; i++)
+                    for(unsigned int b = 0; b < 8; b++)
+                        value[i] |= ((i >> b) & 1) << (3 * b);
+            }
+            unsigned int value[256];
+        };
+        static constexpr Spread SPREAD = Spread();
+    };
+
+    // Whole keys
+
+    static Key encode(unsigned long long x, unsigned long long y, unsigned long long z) { return compose(x, y, z, static_cast<Key *>(0)); }
+
+    static unsigned long long compose(unsigned long long x, unsigned long long y, unsigned long long z, unsigned long long *) {
+        return interleave(x, y, z);
+    }
+    static Morton_Key compose(unsigned long long x, unsigned long long y, unsigned long long z, Morton_Key *) {
+        Morton_Key k;
+        k.high = interleave(x >> 16, y >> 16, z >> 16);
+        k.low = interleave(x & 0xffff, y & 0xffff, z & 0xffff);
+        return k;
+    }
+
+    static void decode(unsigned long long k, unsigned int & x, unsigned int & y, unsigned int & z) { deinterleave(k, x, y, z); }
+    static void decode(const Morton_Key & k, unsigned int & x, unsigned int & y, unsigned int & z) {
+        unsigned int hx, hy, hz;
+        deinterleave(k.high, hx, hy, hz);
+        deinterleave(k.low, x, y, z);
+        x |= hx << 16;
+        y |= hy << 16;
+        z |= hz << 16;
+    }
+
+    static unsigned long long successor(unsigned long long k) { return k + 1; }
+    static Morton_Key successor(const Morton_Key & k) {
+        Morton_Key s = k;
+        if(s.low == Morton_Key::HALF) {
+            s.low = 0;
+            s.high++;
+        } else
+            s.low++;
+        return s;
+    }
+};
+
+template<typename T>
+constexpr typename Morton<T>::Table::Spread Morton<T>::Table::SPREAD;
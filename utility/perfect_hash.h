@@ -0,0 +1,340 @@
+#pragma once
+
+// EPOS Perfect Hash Utility Declarations
+
+// Minimal perfect hashing of up to CAPACITY distinct 32-bit keys (e.g. SmartData Unit codes) by hash and displace (CHD):
+// keys are split into buckets of about two by a first hash, and each bucket, largest first, is given the displacement
+// that sends all its keys to free slots by a second hash. With n keys there are exactly n slots, and looking a key up
+// takes two multiplicative hashes, one displacement load and a key compare, whatever the key set.
+// Building is constexpr, so sets known at compile time (see Perfect_Hash_Set) are hashed by the compiler.
+// Construction fails (valid() is false) if the keys are not distinct, or in the unlikely case that no displacement is found.
+
+template<unsigned int CAPACITY>
+class Perfect_Hash
+{
+public:
+    static const unsigned int BUCKETS = (CAPACITY + 1) / 2;
+    static const unsigned int NOT_FOUND = CAPACITY;
+
+private:
+    static const unsigned int SEEDS = 16;
+    static const unsigned int DISPLACEMENTS = 1 << 16;
+
+public:
+    constexpr Perfect_Hash(): _key{}, _displacement{}, _count(0), _buckets(1), _seed(0), _valid(true) {}
+
+    template<unsigned int N>
+    constexpr Perfect_Hash(const unsigned int (& keys)[N]): Perfect_Hash(keys, N) {}
+
+    constexpr Perfect_Hash(const unsigned int * keys, unsigned int n): _key{}, _displacement{}, _count(n), _buckets((n + 1) / 2 ? (n + 1) / 2 : 1), _seed(0), _valid(false) {
+        if(n > CAPACITY)
+            return;
+        for(unsigned int i = 0; i < n; i++)
+            for(unsigned int j = i + 1; j < n; j++)
+                if(keys[i] == keys[j])
+                    return;
+        for(unsigned int s = 0; !_valid && (s < SEEDS); s++) {
+            _seed = s * 0x9e3779b9U;
+            _valid = build(keys);
+        }
+    }
+
+    // Slot of key in [0, size()), or NOT_FOUND if key is not in the set
+    constexpr unsigned int find(unsigned int key) const {
+        unsigned int s = slot(key);
+        return ((s < _count) && (_key[s] == key)) ? s : NOT_FOUND;
+    }
+
+    // Slot key would take if it were in the set (i.e. without checking); any value in [0, size()) for other keys
+    constexpr unsigned int slot(unsigned int key) const {
+        return reduce(mix(key ^ _displacement[reduce(mix(key ^ _seed), _buckets)]), _count);
+    }
+
+    // Key in a slot
+    constexpr unsigned int key(unsigned int slot) const { return _key[slot]; }
+
+    constexpr unsigned int size() const { return _count; }
+    constexpr bool valid() const { return _valid; }
+
+private:
+    constexpr bool build(const unsigned int * keys) {
+        unsigned int bucket[CAPACITY ? CAPACITY : 1] = {};
+        unsigned int sizes[BUCKETS ? BUCKETS : 1] = {};
+        bool taken[CAPACITY ? CAPACITY : 1] = {};
+        unsigned int largest = 0;
+
+        for(unsigned int i = 0; i < _count; i++) {
+            bucket[i] = reduce(mix(keys[i] ^ _seed), _buckets);
+            sizes[bucket[i]]++;
+            if(sizes[bucket[i]] > largest)
+                largest = sizes[bucket[i]];
+        }
+
+        for(unsigned int size = largest; size > 0; size--)
+            for(unsigned int b = 0; b < _buckets; b++) {
+                if(sizes[b] != size)
+                    continue;
+
+                bool placed = false;
+                for(unsigned int d = 0; !placed && (d < DISPLACEMENTS); d++) {
+                    unsigned int displacement = mix(d + 1);
+                    unsigned int slots[CAPACITY ? CAPACITY : 1] = {};
+                    unsigned int n = 0;
+                    placed = true;
+                    for(unsigned int i = 0; placed && (i < _count); i++)
+                        if(bucket[i] == b) {
+                            unsigned int s = reduce(mix(keys[i] ^ displacement), _count);
+                            placed = !taken[s];
+                            for(unsigned int j = 0; j < n; j++)
+                                placed = placed && (slots[j] != s);
+                            slots[n++] = s;
+                        }
+                    if(placed) {
+                        _displacement[b] = displacement;
+                        for(unsigned int j = 0; j < n; j++)
+                            taken[slots[j]] = true;
+                    }
+                }
+                if(!placed)
+                    return false;
+            }
+
+        for(unsigned int i = 0; i < _count; i++)
+            _key[slot(keys[i])] = keys[i];
+        return true;
+    }
+
+    // Murmur3 finalizer
+    static constexpr unsigned int mix(unsigned int x) {
+        x ^= x >> 16;
+        x *= 0x85ebca6bU;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35U;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Maps a hash to [0, n) with a multiply instead of a division
+    static constexpr unsigned int reduce(unsigned int h, unsigned int n) {
+        return static_cast<unsigned int>((static_cast<unsigned long long>(h) * n) >> 32);
+    }
+
+private:
+    unsigned int _key[CAPACITY ? CAPACITY : 1];
+    unsigned int _displacement[BUCKETS ? BUCKETS : 1];
+    unsigned int _count;
+    unsigned int _buckets;
+    unsigned int _seed;
+    bool _valid;
+};
+
+// Perfect hash of a set of keys known at compile time, e.g. Perfect_Hash_Set<Unit::Temperature, Unit::Pressure>::find(u)
+template<unsigned int ... KEYS>
+struct Perfect_Hash_Set {
+    static const unsigned int SIZE = sizeof...(KEYS);
+    static constexpr unsigned int LIST[SIZE ? SIZE : 1] = { KEYS ... };
+    static constexpr Perfect_Hash<SIZE> HASH = Perfect_Hash<SIZE>(LIST, SIZE);
+    static_assert(HASH.valid(), "Perfect_Hash_Set keys must be distinct");
+
+    static constexpr unsigned int find(unsigned int key) { return HASH.find(key); }
+};
+
+template<unsigned int ... KEYS>
+constexpr unsigned int Perfect_Hash_Set<KEYS ...>::LIST[];
+template<unsigned int ... KEYS>
+constexpr Perfect_Hash<Perfect_Hash_Set<KEYS ...>::SIZE> Perfect_Hash_Set<KEYS ...>::HASH;
+
+// Dispatch of keys (e.g. the Unit of incoming SmartData) to up to CAPACITY handlers through a Perfect_Hash, with
+// unregistered keys going to a default handler. The key set can be changed while other threads dispatch: writers
+// (serialized among themselves by a spin lock) build a new table and publish it with an atomic store, so dispatch() is
+// a single acquire load of the table plus the lookup, and shares no written cache line with other threads.
+// Replaced tables are reclaimed by quiescent states: each thread that dispatches holds a Reader, on which it calls
+// quiescent() from time to time while it is not inside dispatch() (e.g. after each batch of frames). A replaced table
+// goes on a retire list tagged with a new epoch, and a later update frees it once every Reader has announced that
+// epoch. Writers thus never wait for readers; a Reader that stops announcing only delays reclamation (tables are
+// small, and prefer bind() to a series of insert()s when the whole set changes). Threads without a Reader must not
+// dispatch while the key set may change.
+template<typename Handler, unsigned int CAPACITY = 64>
+class Dispatcher
+{
+public:
+    struct Entry {
+        unsigned int key;
+        Handler handler;
+    };
+
+    // Registration of a dispatching thread, on a cache line of its own
+    class alignas(64) Reader {
+        friend class Dispatcher;
+
+    public:
+        Reader(Dispatcher & d): _dispatcher(&d) {
+            d.lock();
+            _epoch = d._epoch;
+            _next = d._readers;
+            d._readers = this;
+            d.unlock();
+        }
+
+        ~Reader() {
+            _dispatcher->lock();
+            Reader ** r = &_dispatcher->_readers;
+            while(*r != this)
+                r = &(*r)->_next;
+            *r = _next;
+            _dispatcher->unlock();
+        }
+
+        Reader(const Reader &) = delete;
+        Reader & operator=(const Reader &) = delete;
+
+        // Announces that this thread holds nothing it got from the dispatcher's tables
+        void quiescent() {
+            unsigned long long e = __atomic_load_n(&_dispatcher->_epoch, __ATOMIC_ACQUIRE);
+            if(e != _epoch)
+                __atomic_store_n(&_epoch, e, __ATOMIC_RELEASE);
+        }
+
+    private:
+        unsigned long long _epoch;
+        Dispatcher * _dispatcher;
+        Reader * _next;
+    };
+
+private:
+    struct Table {
+        Table(const unsigned int * keys, unsigned int n): hash(keys, n), epoch(0), retired(0) {}
+
+        Perfect_Hash<CAPACITY> hash;
+        Handler handler[CAPACITY ? CAPACITY : 1];
+        unsigned long long epoch; // of retirement
+        Table * retired;
+    };
+
+public:
+    Dispatcher(const Handler & fallback = Handler()): _lock(false), _fallback(fallback), _table(0), _retired(0), _epoch(0), _readers(0) { bind(0, 0); }
+    ~Dispatcher() {
+        delete _table;
+        while(_retired) {
+            Table * t = _retired;
+            _retired = t->retired;
+            delete t;
+        }
+    }
+
+    Dispatcher(const Dispatcher &) = delete;
+    Dispatcher & operator=(const Dispatcher &) = delete;
+
+    Handler dispatch(unsigned int key) const {
+        const Table * t = __atomic_load_n(&_table, __ATOMIC_ACQUIRE);
+        unsigned int s = t->hash.slot(key);
+        return (t->hash.key(s) == key) ? t->handler[s] : _fallback; // unused slots also hold the fallback (e.g. with no keys)
+    }
+
+    // Replaces the whole key set; false (and no change) if the entries do not fit or repeat a key
+    bool bind(const Entry * entries, unsigned int n) {
+        lock();
+        bool ok = publish(entries, n);
+        unlock();
+        return ok;
+    }
+
+    // Adds (or replaces the handler of) a key
+    bool insert(unsigned int key, const Handler & handler) {
+        lock();
+        Entry e[CAPACITY + 1];
+        unsigned int n = current(e, key);
+        e[n].key = key;
+        e[n].handler = handler;
+        bool ok = publish(e, n + 1);
+        unlock();
+        return ok;
+    }
+
+    bool remove(unsigned int key) {
+        lock();
+        Entry e[CAPACITY ? CAPACITY : 1];
+        unsigned int n = current(e, key);
+        bool ok = publish(e, n);
+        unlock();
+        return ok;
+    }
+
+    bool contains(unsigned int key) const {
+        const Table * t = __atomic_load_n(&_table, __ATOMIC_ACQUIRE);
+        return t->hash.find(key) != Perfect_Hash<CAPACITY>::NOT_FOUND;
+    }
+
+    unsigned int size() const { return __atomic_load_n(&_table, __ATOMIC_ACQUIRE)->hash.size(); }
+
+private:
+    // Entries of the current table but key
+    unsigned int current(Entry * e, unsigned int key) const {
+        const Table * t = _table;
+        unsigned int n = 0;
+        for(unsigned int i = 0; i < t->hash.size(); i++)
+            if(t->hash.key(i) != key) {
+                e[n].key = t->hash.key(i);
+                e[n].handler = t->handler[i];
+                n++;
+            }
+        return n;
+    }
+
+    bool publish(const Entry * entries, unsigned int n) {
+        if(n > CAPACITY)
+            return false;
+        unsigned int keys[CAPACITY ? CAPACITY : 1];
+        for(unsigned int i = 0; i < n; i++)
+            keys[i] = entries[i].key;
+        Table * t = new Table(keys, n);
+        if(!t->hash.valid()) {
+            delete t;
+            return false;
+        }
+        for(unsigned int i = 0; i < (CAPACITY ? CAPACITY : 1); i++)
+            t->handler[i] = _fallback;
+        for(unsigned int i = 0; i < n; i++)
+            t->handler[t->hash.find(entries[i].key)] = entries[i].handler;
+
+        Table * old = _table;
+        __atomic_store_n(&_table, t, __ATOMIC_RELEASE);
+        if(old) {
+            // Readers that announce the new epoch acquired it after the store above, so they no longer see old
+            old->epoch = _epoch + 1;
+            old->retired = _retired;
+            _retired = old;
+            __atomic_store_n(&_epoch, old->epoch, __ATOMIC_RELEASE);
+        }
+        reclaim();
+        return true;
+    }
+
+    // Frees the retired tables every Reader has announced the epoch of
+    void reclaim() {
+        unsigned long long e = _epoch;
+        for(const Reader * r = _readers; r; r = r->_next) {
+            unsigned long long a = __atomic_load_n(&r->_epoch, __ATOMIC_ACQUIRE);
+            if(a < e)
+                e = a;
+        }
+        for(Table ** t = &_retired; *t; )
+            if((*t)->epoch <= e) {
+                Table * f = *t;
+                *t = f->retired;
+                delete f;
+            } else
+                t = &(*t)->retired;
+    }
+
+    void lock() { while(__atomic_test_and_set(&_lock, __ATOMIC_ACQUIRE)); }
+    void unlock() { __atomic_clear(&_lock, __ATOMIC_RELEASE); }
+
+private:
+    bool _lock;
+    Handler _fallback;
+    Table * _table;
+    Table * _retired; // newest first
+    unsigned long long _epoch;
+    Reader * _readers;
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+// EPOS Quantizer Utility Declarations
+
+// Lossy, uncertainty-aware encoding of floating-point samples (e.g. F32/D64 SmartData values): each sample is quantized
+// to a step of twice the declared uncertainty, relative to the smallest sample, so the decoded value is within the
+// uncertainty of the original (give or take the rounding of the arithmetic itself), and the integers are bit packed in
+// the minimum width that holds them. A frame is | Header | packed samples |, with the header fields in big-endian.
+// Bits are packed LSB first in a little-endian byte stream, so decoding takes one unaligned 64-bit load per sample.
+// Frames whose samples cannot be quantized (non-finite values, a non-positive uncertainty, or a range needing as many
+// bits as T itself, or over MAX_BITS) are stored raw, as big-endian values, instead, so no frame is larger than max_size().
+
+#include "endian.h"
+
+template<typename T>
+class Quantizer
+{
+public:
+    static const unsigned char RAW = 0xff;
+    static const unsigned int MAX_BITS = 57; // so a sample plus its bit offset always fits in a 64-bit load
+
+private:
+    static const unsigned int LIMIT = (8 * sizeof(T) - 1 < MAX_BITS) ? 8 * sizeof(T) - 1 : MAX_BITS; // widest packing that beats RAW
+
+public:
+    struct Header {
+        double base;
+        double step;
+        unsigned int count;
+        unsigned char bits;
+    } __attribute__((packed));
+
+public:
+    // Worst-case size of a frame with n samples
+    static constexpr unsigned long max_size(unsigned int n) { return sizeof(Header) + static_cast<unsigned long>(n) * sizeof(T); }
+
+    // Size of a frame with n samples of the given width
+    static constexpr unsigned long size(unsigned int n, unsigned char bits) {
+        return sizeof(Header) + ((bits == RAW) ? static_cast<unsigned long>(n) * sizeof(T) : (static_cast<unsigned long>(n) * bits + 7) / 8);
+    }
+
+    // Encodes n samples into frame (of size bytes); returns the length of the frame, or 0 if it would not fit
+    static unsigned long encode(char * frame, unsigned long size, const T * samples, unsigned int n, double uncertainty) {
+        Header h = { 0, 0, n, RAW };
+        if(n && (uncertainty > 0)) {
+            double smallest = samples[0], largest = samples[0];
+            bool finite = true;
+            for(unsigned int i = 0; i < n; i++) {
+                double v = samples[i];
+                finite = finite && (v - v == 0); // false for NaNs and infinities
+                smallest = (v < smallest) ? v : smallest;
+                largest = (v > largest) ? v : largest;
+            }
+            double step = 2 * uncertainty;
+            double range = (largest - smallest) * (1 / step) + 0.5; // as samples are quantized below, so none exceeds it
+            if(finite && (range < static_cast<double>(1ULL << LIMIT))) {
+                unsigned long long q = static_cast<unsigned long long>(range);
+                h.base = smallest;
+                h.step = step;
+                h.bits = q ? 64 - __builtin_clzll(q) : 0;
+            }
+        }
+
+        unsigned long length = Quantizer::size(n, h.bits);
+        if(length > size)
+            return 0;
+
+        Header * wire = reinterpret_cast<Header *>(frame);
+        wire->base = Endian::htobe(h.base);
+        wire->step = Endian::htobe(h.step);
+        wire->count = Endian::htobe(h.count);
+        wire->bits = h.bits;
+
+        unsigned char * p = reinterpret_cast<unsigned char *>(frame + sizeof(Header));
+        if(h.bits == RAW) {
+            Endian::htobe<sizeof(T)>(p, samples, n);
+            return length;
+        }
+        if(!h.bits)
+            return length;
+
+        double inverse = 1 / h.step;
+        unsigned long long acc = 0;
+        unsigned int filled = 0;
+        for(unsigned int i = 0; i < n; i++) {
+            unsigned long long q = static_cast<unsigned long long>((samples[i] - h.base) * inverse + 0.5);
+            acc |= q << filled;
+            filled += h.bits;
+            while(filled >= 8) {
+                *p++ = static_cast<unsigned char>(acc);
+                acc >>= 8;
+                filled -= 8;
+            }
+        }
+        if(filled)
+            *p++ = static_cast<unsigned char>(acc);
+        return length;
+    }
+
+    // Decodes a frame (of size bytes) into up to max samples; returns the number of samples in the frame, or 0 if the
+    // frame is truncated or holds more than max samples
+    static unsigned int decode(T * samples, unsigned int max, const char * frame, unsigned long size) {
+        if(size < sizeof(Header))
+            return 0;
+
+        const Header * wire = reinterpret_cast<const Header *>(frame);
+        double base = Endian::betoh(wire->base);
+        double step = Endian::betoh(wire->step);
+        unsigned int n = Endian::betoh(wire->count);
+        unsigned char bits = wire->bits;
+        if((n > max) || ((bits != RAW) && (bits > MAX_BITS)) || (Quantizer::size(n, bits) > size))
+            return 0;
+
+        const unsigned char * p = reinterpret_cast<const unsigned char *>(frame + sizeof(Header));
+        if(bits == RAW) {
+            Endian::betoh<sizeof(T)>(samples, p, n);
+            return n;
+        }
+        if(!bits) {
+            for(unsigned int i = 0; i < n; i++)
+                samples[i] = base;
+            return n;
+        }
+
+        const unsigned long long mask = (1ULL << bits) - 1;
+        const unsigned long bytes = size - sizeof(Header);
+        unsigned long position = 0;
+        unsigned int i = 0;
+        // Fast path: a single unaligned 64-bit load per sample, as long as it stays within the frame
+        for(; (i < n) && ((position >> 3) + 8 <= bytes); i++, position += bits) {
+            unsigned long long w;
+            __builtin_memcpy(&w, &p[position >> 3], sizeof(w));
+            if(Endian::big())
+                w = Endian::bswap(w);
+            samples[i] = base + static_cast<double>((w >> (position & 7)) & mask) * step;
+        }
+        // Tail: gather the remaining bytes one by one
+        for(; i < n; i++, position += bits) {
+            unsigned long long w = 0;
+            for(unsigned long b = position >> 3, s = 0; (b < bytes) && (s < 64); b++, s += 8)
+                w |= static_cast<unsigned long long>(p[b]) << s;
+            samples[i] = base + static_cast<double>((w >> (position & 7)) & mask) * step;
+        }
+        return n;
+    }
+};
@@ -0,0 +1,446 @@
+#pragma once
+
+// EPOS Memory-Mapped Record Log Utility Declarations
+
+// Append-only log of timestamped, fixed-size records (anything providing serialize(char *), deserialize(const char *)
+// and a static serialized_size(), e.g. MultiUnitSmartData), split in preallocated segment files.
+//
+// Segment layout: | Header | Index[CAPACITY / STRIDE] | Entry[CAPACITY] |, with each Entry being | Int64 time (us) | record |.
+// Records must be appended in non-decreasing time order. The sparse Index holds the time of every STRIDE-th entry, so
+// a seek binary-searches the compact index (touching a handful of pages) and then at most STRIDE entries.
+// Writers never fsync: a full segment is msync'ed with MS_ASYNC and unmapped, and the kernel writes it back on its own.
+// A writer restarted on an existing log goes on after its last segment (segments are created with O_EXCL, so nothing on
+// disk is ever truncated; only segments left empty at the end of the log, by a writer that stopped right after opening
+// them, are removed and their sequence numbers reused), and time order is kept across segments, so a Reader can seek
+// the log as a whole.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template<typename Record, unsigned int STRIDE = 64>
+class Record_Log
+{
+public:
+    typedef long long Time;
+
+    static const unsigned int MAGIC = 0x534d444c; // "SMDL"
+    static const unsigned int ENTRY_SIZE = sizeof(Time) + Record::serialized_size();
+
+    struct Header {
+        unsigned int magic;
+        unsigned int entry_size;
+        unsigned int capacity;
+        unsigned int stride;
+        volatile unsigned int count;
+        unsigned int padding;
+        Time t0;
+        Time t1;
+    };
+
+    static unsigned long segment_size(unsigned int capacity) { return sizeof(Header) + index_size(capacity) * sizeof(Time) + static_cast<unsigned long>(capacity) * ENTRY_SIZE; }
+
+    class Writer;
+    class Segment;
+    class Reader;
+
+private:
+    static const Time MAX_TIME = ~(1ULL << 63);
+
+    static unsigned int index_size(unsigned int capacity) { return (capacity + STRIDE - 1) / STRIDE; }
+
+    static void path(char * buffer, unsigned int size, const char * prefix, unsigned int sequence) { snprintf(buffer, size, "%s.%06u.log", prefix, sequence); }
+
+    // Lowest and highest sequence numbers of the segments of prefix on disk; false if there are none
+    static bool scan(const char * prefix, unsigned int & first, unsigned int & last) {
+        const char * slash = strrchr(prefix, '/');
+        char dir[256];
+        if(slash)
+            snprintf(dir, sizeof(dir), "%.*s", static_cast<int>(slash - prefix) + 1, prefix);
+        else
+            snprintf(dir, sizeof(dir), ".");
+        const char * name = slash ? slash + 1 : prefix;
+        unsigned long length = strlen(name);
+
+        DIR * d = opendir(dir);
+        if(!d)
+            return false;
+        bool found = false;
+        for(struct dirent * e = readdir(d); e; e = readdir(d)) {
+            const char * n = e->d_name;
+            if(strncmp(n, name, length) || (n[length] != '.') || (n[length + 1] < '0') || (n[length + 1] > '9'))
+                continue;
+            char * end;
+            unsigned long sequence = strtoul(n + length + 1, &end, 10);
+            if(strcmp(end, ".log") || (sequence > ~0U))
+                continue;
+            if(!found || (sequence < first))
+                first = sequence;
+            if(!found || (sequence > last))
+                last = sequence;
+            found = true;
+        }
+        closedir(d);
+        return found;
+    }
+};
+
+
+template<typename Record, unsigned int STRIDE>
+class Record_Log<Record, STRIDE>::Writer
+{
+public:
+    // Segments are named <prefix>.<sequence>.log and hold up to capacity records each; if the log already exists, new
+    // segments follow its last one (checked on the first append)
+    Writer(const char * prefix, unsigned int capacity): _prefix(prefix), _capacity(capacity), _sequence(0), _fd(-1), _base(0), _header(0), _last(0), _scanned(false), _empty(true) {}
+    ~Writer() { close(); }
+
+    Writer(const Writer &) = delete;
+    Writer & operator=(const Writer &) = delete;
+
+    // Appends a record, opening a new segment when the current one is full; returns false on I/O errors (including a
+    // segment file that already exists) or if time goes backwards, also with respect to earlier segments
+    bool append(const Time & time, Record & record) {
+        if(!_scanned)
+            resume();
+        if(!_empty && (time < _last))
+            return false;
+
+        if(!_header || (_header->count == _capacity))
+            if(!roll())
+                return false;
+
+        unsigned int i = _header->count;
+
+        char * entry = entries() + static_cast<unsigned long>(i) * ENTRY_SIZE;
+        __builtin_memcpy(entry, &time, sizeof(Time));
+        record.serialize(entry + sizeof(Time));
+
+        if(!(i % STRIDE))
+            index()[i / STRIDE] = time;
+        if(!i)
+            _header->t0 = time;
+        _header->t1 = time;
+        __atomic_store_n(&_header->count, i + 1, __ATOMIC_RELEASE);
+        _last = time;
+        _empty = false;
+        return true;
+    }
+
+    // Schedules the write back of the current segment without waiting for it
+    void flush() {
+        if(_base)
+            msync(_base, segment_size(_capacity), MS_ASYNC);
+    }
+
+    unsigned int sequence() const { return _sequence; }
+
+private:
+    // Goes on after the last segment of an existing log, taking the time of its last record as the floor for new ones.
+    // Empty segments at the end of the log are removed and their sequence numbers reused, so no empty segment is ever
+    // left between two with records (which would break a Reader's seek over segment times).
+    void resume() {
+        _scanned = true;
+        unsigned int first, last;
+        if(!scan(_prefix, first, last))
+            return;
+        _sequence = last + 1;
+        bool trailing = true;
+        for(unsigned int s = last + 1; s-- > first; ) {
+            char name[256];
+            path(name, sizeof(name), _prefix, s);
+            Segment segment;
+            bool valid = segment.open(name);
+            if(valid && segment.count()) {
+                _last = segment.t1();
+                _empty = false;
+                return;
+            }
+            if(valid && trailing && (s + 1 == _sequence)) {
+                segment.close();
+                if(!unlink(name))
+                    _sequence = s;
+            } else
+                trailing = false;
+        }
+    }
+
+    bool roll() {
+        close();
+
+        char name[256];
+        path(name, sizeof(name), _prefix, _sequence);
+
+        _fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if(_fd < 0)
+            return false;
+        if(ftruncate(_fd, segment_size(_capacity))) {
+            close();
+            unlink(name);
+            return false;
+        }
+        void * base = mmap(0, segment_size(_capacity), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if(base == MAP_FAILED) {
+            close();
+            unlink(name);
+            return false;
+        }
+
+        _base = reinterpret_cast<char *>(base);
+        _header = reinterpret_cast<Header *>(_base);
+        _header->magic = MAGIC;
+        _header->entry_size = ENTRY_SIZE;
+        _header->capacity = _capacity;
+        _header->stride = STRIDE;
+        _header->count = 0;
+        _header->t0 = _header->t1 = 0;
+        _sequence++;
+        return true;
+    }
+
+    void close() {
+        if(_base) {
+            msync(_base, segment_size(_capacity), MS_ASYNC);
+            munmap(_base, segment_size(_capacity));
+        }
+        if(_fd >= 0)
+            ::close(_fd);
+        _fd = -1;
+        _base = 0;
+        _header = 0;
+    }
+
+    Time * index() { return reinterpret_cast<Time *>(_base + sizeof(Header)); }
+    char * entries() { return _base + sizeof(Header) + index_size(_capacity) * sizeof(Time); }
+
+private:
+    const char * _prefix;
+    unsigned int _capacity;
+    unsigned int _sequence;
+    int _fd;
+    char * _base;
+    Header * _header;
+    Time _last;     // time of the last record in the log
+    bool _scanned;
+    bool _empty;
+};
+
+
+// A single segment
+template<typename Record, unsigned int STRIDE>
+class Record_Log<Record, STRIDE>::Segment
+{
+public:
+    Segment(): _size(0), _base(0), _header(0) {}
+    ~Segment() { close(); }
+
+    Segment(const Segment &) = delete;
+    Segment & operator=(const Segment &) = delete;
+
+    // Maps a segment read-only; nothing but the header is read until records are accessed
+    bool open(const char * path) {
+        close();
+
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) || (static_cast<unsigned long>(st.st_size) < sizeof(Header))) {
+            ::close(fd);
+            return false;
+        }
+        void * base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(base == MAP_FAILED)
+            return false;
+
+        _size = st.st_size;
+        _base = reinterpret_cast<const char *>(base);
+        _header = reinterpret_cast<const Header *>(_base);
+        if((_header->magic != MAGIC) || (_header->entry_size != ENTRY_SIZE) || (_header->stride != STRIDE) || (_size < segment_size(_header->capacity))) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if(_base)
+            munmap(const_cast<char *>(_base), _size);
+        _size = 0;
+        _base = 0;
+        _header = 0;
+    }
+
+    unsigned int count() const { return __atomic_load_n(&_header->count, __ATOMIC_ACQUIRE); }
+    Time t0() const { return _header->t0; }
+    Time t1() const { return _header->t1; }
+
+    Time time(unsigned int i) const {
+        Time t;
+        __builtin_memcpy(&t, entry(i), sizeof(Time));
+        return t;
+    }
+
+    void read(unsigned int i, Record & record) const { record.deserialize(entry(i) + sizeof(Time)); }
+
+    // Position of the first record whose time is >= t (count() if none), in O(log n)
+    unsigned int seek(const Time & t) const {
+        unsigned int n = count();
+        const Time * idx = index();
+
+        // Last index block starting before t
+        unsigned int l = 0, h = (n + STRIDE - 1) / STRIDE;
+        while(l < h) {
+            unsigned int m = (l + h) / 2;
+            if(idx[m] < t)
+                l = m + 1;
+            else
+                h = m;
+        }
+        if(!l)
+            return 0;
+
+        unsigned int i = (l - 1) * STRIDE;
+        unsigned int e = (l * STRIDE < n) ? l * STRIDE : n;
+        while((i < e) && (time(i) < t))
+            i++;
+        return i;
+    }
+
+    // Records within an interval (anything with t0 and t1, e.g. Space_Time::Time_Interval) are those in [begin, end)
+    template<typename Interval>
+    void seek(const Interval & interval, unsigned int & begin, unsigned int & end) const {
+        begin = seek(static_cast<Time>(interval.t0));
+        end = (static_cast<Time>(interval.t1) == MAX_TIME) ? count() : seek(static_cast<Time>(interval.t1) + 1);
+        if(end < begin)
+            end = begin;
+    }
+
+private:
+    const Time * index() const { return reinterpret_cast<const Time *>(_base + sizeof(Header)); }
+    const char * entry(unsigned int i) const { return _base + sizeof(Header) + index_size(_header->capacity) * sizeof(Time) + static_cast<unsigned long>(i) * ENTRY_SIZE; }
+
+private:
+    unsigned long _size;
+    const char * _base;
+    const Header * _header;
+};
+
+
+// The whole log: the segments on disk when it is opened (the last of which may still be growing), with records numbered
+// across them
+template<typename Record, unsigned int STRIDE>
+class Record_Log<Record, STRIDE>::Reader
+{
+public:
+    typedef unsigned long long Position;
+
+public:
+    Reader(): _segments(0), _first(0), _n(0) {}
+    ~Reader() { close(); }
+
+    Reader(const Reader &) = delete;
+    Reader & operator=(const Reader &) = delete;
+
+    // Maps every valid segment of prefix (but empty ones other than the last, which a writer may be filling); false if
+    // there are none
+    bool open(const char * prefix) {
+        close();
+
+        unsigned int first, last;
+        if(!scan(prefix, first, last))
+            return false;
+
+        unsigned int n = last - first + 1;
+        _segments = new Segment[n];
+        _first = new Position[n];
+        Position count = 0;
+        for(unsigned int s = first; s - first < n; s++) {
+            char name[256];
+            path(name, sizeof(name), prefix, s);
+            if(!_segments[_n].open(name) || (!_segments[_n].count() && (s != last)))
+                continue;
+            _first[_n] = count;
+            count += _segments[_n].count();
+            _n++;
+        }
+        if(!_n) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        delete[] _segments;
+        delete[] _first;
+        _segments = 0;
+        _first = 0;
+        _n = 0;
+    }
+
+    unsigned int segments() const { return _n; }
+    const Segment & segment(unsigned int s) const { return _segments[s]; }
+
+    Position count() const { return _n ? _first[_n - 1] + _segments[_n - 1].count() : 0; }
+
+    Time time(const Position & i) const {
+        unsigned int s = locate(i);
+        return _segments[s].time(i - _first[s]);
+    }
+
+    void read(const Position & i, Record & record) const {
+        unsigned int s = locate(i);
+        _segments[s].read(i - _first[s], record);
+    }
+
+    // Position of the first record whose time is >= t (count() if none): a binary search over the segments' last times,
+    // then a seek within the segment found
+    Position seek(const Time & t) const {
+        unsigned int l = 0, h = _n;
+        while(l < h) {
+            unsigned int m = (l + h) / 2;
+            if(!_segments[m].count() || (_segments[m].t1() < t))
+                l = m + 1;
+            else
+                h = m;
+        }
+        if(l == _n)
+            return count();
+        return _first[l] + _segments[l].seek(t);
+    }
+
+    // Records within an interval (anything with t0 and t1, e.g. Space_Time::Time_Interval) are those in [begin, end)
+    template<typename Interval>
+    void seek(const Interval & interval, Position & begin, Position & end) const {
+        begin = seek(static_cast<Time>(interval.t0));
+        end = (static_cast<Time>(interval.t1) == MAX_TIME) ? count() : seek(static_cast<Time>(interval.t1) + 1);
+        if(end < begin)
+            end = begin;
+    }
+
+private:
+    // Segment holding record i (the last one for positions past the end)
+    unsigned int locate(const Position & i) const {
+        unsigned int l = 1, h = _n;
+        while(l < h) {
+            unsigned int m = (l + h) / 2;
+            if(_first[m] <= i)
+                l = m + 1;
+            else
+                h = m;
+        }
+        return l - 1;
+    }
+
+private:
+    Segment * _segments;
+    Position * _first;   // position of the first record of each segment
+    unsigned int _n;
+};
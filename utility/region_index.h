@@ -0,0 +1,353 @@
+#pragma once
+
+// EPOS Spatio-Temporal Region Index Utility Declarations
+
+// Index of many interest regions (spheres valid within a time interval, e.g. Space_Time::_Region<S>) answering which of
+// them contain a point in space and time without testing them all. Space is split in a uniform grid of cubic cells,
+// kept in an open-addressing hash table, and each region is listed in every cell its bounding box overlaps (regions
+// overlapping more than MAX_CELLS cells are kept apart, in a list every query goes through). A query thus only tests
+// the regions of a single cell, first against their time interval and then with Region::contains().
+// Regions can be inserted and removed at any time, and expire() drops those whose interval has ended, taking them from
+// a heap ordered by t1. The cell size is best about the diameter of a typical region.
+// Regions must provide center() (with x(), y() and z()), radius(), t0, t1, and contains(const Spacetime &).
+
+template<typename Region, typename Spacetime, unsigned int MAX_CELLS = 64>
+class Region_Index
+{
+public:
+    typedef unsigned int Id;
+    static const Id NONE = ~0U;
+
+private:
+    struct Cell {
+        long long x, y, z;
+        unsigned int head; // first posting, or NONE if empty
+        bool used;
+    };
+
+    struct Box {
+        long long x0, y0, z0, x1, y1, z1; // in cells, inclusive
+
+        // Number of cells, or just over MAX_CELLS if larger (so huge regions do not overflow it)
+        unsigned long long cells() const {
+            unsigned long long x = x1 - x0 + 1, y = y1 - y0 + 1, z = z1 - z0 + 1;
+            return ((x > MAX_CELLS) || (y > MAX_CELLS) || (z > MAX_CELLS)) ? MAX_CELLS + 1 : x * y * z;
+        }
+    };
+
+public:
+    Region_Index(unsigned long long cell)
+    : _cell(cell ? cell : 1), _cells(0), _cells_used(0), _cells_capacity(0), _postings(0), _next(0), _postings_capacity(0), _free_posting(NONE),
+      _regions(0), _live(0), _heap_position(0), _regions_capacity(0), _free_region(NONE), _heap(0), _size(0), _large(NONE) {
+        rehash(64);
+    }
+
+    ~Region_Index() {
+        delete[] _cells;
+        delete[] _postings;
+        delete[] _next;
+        delete[] _regions;
+        delete[] _live;
+        delete[] _heap_position;
+        delete[] _heap;
+    }
+
+    Region_Index(const Region_Index &) = delete;
+    Region_Index & operator=(const Region_Index &) = delete;
+
+    Id insert(const Region & r) {
+        if(_free_region == NONE)
+            grow_regions();
+        Id id = _free_region;
+        _free_region = _heap_position[id];
+        _regions[id] = r;
+        _live[id] = true;
+
+        Box b = box(r);
+        if(b.cells() > MAX_CELLS)
+            link(_large, id);
+        else
+            for(long long x = b.x0; x <= b.x1; x++)
+                for(long long y = b.y0; y <= b.y1; y++)
+                    for(long long z = b.z0; z <= b.z1; z++)
+                        link(cell(x, y, z, true)->head, id);
+
+        _heap[_size] = id;
+        _heap_position[id] = _size;
+        up(_size++);
+        return id;
+    }
+
+    bool remove(Id id) {
+        if((id >= _regions_capacity) || !_live[id])
+            return false;
+
+        Box b = box(_regions[id]);
+        if(b.cells() > MAX_CELLS)
+            unlink(_large, id);
+        else
+            for(long long x = b.x0; x <= b.x1; x++)
+                for(long long y = b.y0; y <= b.y1; y++)
+                    for(long long z = b.z0; z <= b.z1; z++)
+                        unlink(cell(x, y, z, false)->head, id);
+
+        unsigned int i = _heap_position[id];
+        _size--;
+        if(i != _size) {
+            _heap[i] = _heap[_size];
+            _heap_position[_heap[i]] = i;
+            down(i);
+            up(i);
+        }
+
+        _live[id] = false;
+        _heap_position[id] = _free_region;
+        _free_region = id;
+        return true;
+    }
+
+    // Removes the regions whose interval ended before now, returning how many
+    unsigned int expire(long long now) {
+        unsigned int n = 0;
+        while(_size && (end(_heap[0]) < now)) {
+            remove(_heap[0]);
+            n++;
+        }
+        return n;
+    }
+
+    const Region & operator[](Id id) const { return _regions[id]; }
+    bool contains(Id id) const { return (id < _regions_capacity) && _live[id]; }
+    unsigned int size() const { return _size; }
+
+    // Calls f(id) for each region containing st
+    template<typename F>
+    void query(const Spacetime & st, F && f) const {
+        const Cell * c = cell(floor(st.space.x()), floor(st.space.y()), floor(st.space.z()));
+        scan(c ? c->head : NONE, st, f);
+        scan(_large, st, f);
+    }
+
+    // Ids of up to max regions containing st; returns how many regions contain it (which may be more than max)
+    unsigned int query(const Spacetime & st, Id * ids, unsigned int max) const {
+        unsigned int n = 0;
+        query(st, [&](Id id) {
+            if(n < max)
+                ids[n] = id;
+            n++;
+        });
+        return n;
+    }
+
+    // Batch query of a frame of n samples, calling f(i, id) for each region containing sample i. Consecutive samples
+    // in the same cell (as usual in a frame from a single source) share the cell lookup.
+    template<typename F>
+    void query(const Spacetime * st, unsigned int n, F && f) const {
+        long long x = 0, y = 0, z = 0;
+        unsigned int head = NONE;
+        for(unsigned int i = 0; i < n; i++) {
+            long long cx = floor(st[i].space.x()), cy = floor(st[i].space.y()), cz = floor(st[i].space.z());
+            if(!i || (cx != x) || (cy != y) || (cz != z)) {
+                const Cell * c = cell(cx, cy, cz);
+                head = c ? c->head : NONE;
+                x = cx;
+                y = cy;
+                z = cz;
+            }
+            scan(head, st[i], [&](Id id) { f(i, id); });
+            scan(_large, st[i], [&](Id id) { f(i, id); });
+        }
+    }
+
+private:
+    template<typename F>
+    void scan(unsigned int p, const Spacetime & st, F && f) const {
+        long long t = static_cast<long long>(st.time);
+        for(; p != NONE; p = _next[p]) {
+            const Region & r = _regions[_postings[p]];
+            if((static_cast<long long>(r.t0) <= t) && (t <= static_cast<long long>(r.t1)) && r.contains(st))
+                f(_postings[p]);
+        }
+    }
+
+    long long floor(long long v) const { return (v >= 0) ? v / static_cast<long long>(_cell) : -((-v + static_cast<long long>(_cell) - 1) / static_cast<long long>(_cell)); }
+
+    Box box(const Region & r) const {
+        long long x = r.center().x(), y = r.center().y(), z = r.center().z(), d = r.radius();
+        Box b = { floor(x - d), floor(y - d), floor(z - d), floor(x + d), floor(y + d), floor(z + d) };
+        return b;
+    }
+
+    // Cells
+
+    static unsigned long long hash(long long x, long long y, long long z) {
+        unsigned long long h = x * 0x9e3779b97f4a7c15ULL;
+        h ^= y * 0xc2b2ae3d27d4eb4fULL + (h >> 29);
+        h ^= z * 0x165667b19e3779f9ULL + (h >> 32);
+        return h ^ (h >> 31);
+    }
+
+    const Cell * cell(long long x, long long y, long long z) const {
+        for(unsigned long long i = hash(x, y, z) & (_cells_capacity - 1); _cells[i].used; i = (i + 1) & (_cells_capacity - 1))
+            if((_cells[i].x == x) && (_cells[i].y == y) && (_cells[i].z == z))
+                return &_cells[i];
+        return 0;
+    }
+
+    Cell * cell(long long x, long long y, long long z, bool create) {
+        Cell * c = const_cast<Cell *>(static_cast<const Region_Index *>(this)->cell(x, y, z));
+        if(c || !create)
+            return c;
+
+        if(2 * (_cells_used + 1) > _cells_capacity)
+            rehash(2 * _cells_capacity);
+        unsigned long long i = hash(x, y, z) & (_cells_capacity - 1);
+        while(_cells[i].used)
+            i = (i + 1) & (_cells_capacity - 1);
+        Cell e = { x, y, z, NONE, true };
+        _cells[i] = e;
+        _cells_used++;
+        return &_cells[i];
+    }
+
+    // Empty cells are only dropped here, so cells left behind by moving regions are reclaimed as the table grows
+    void rehash(unsigned long long capacity) {
+        Cell * old = _cells;
+        unsigned long long n = _cells_capacity;
+        unsigned long long used = 0;
+        for(unsigned long long i = 0; i < n; i++)
+            used += old[i].used && (old[i].head != NONE);
+        while(capacity < 4 * (used + 1))
+            capacity *= 2;
+
+        _cells = new Cell[capacity];
+        _cells_capacity = capacity;
+        _cells_used = 0;
+        for(unsigned long long i = 0; i < capacity; i++)
+            _cells[i].used = false;
+        for(unsigned long long i = 0; i < n; i++)
+            if(old[i].used && (old[i].head != NONE)) {
+                unsigned long long j = hash(old[i].x, old[i].y, old[i].z) & (capacity - 1);
+                while(_cells[j].used)
+                    j = (j + 1) & (capacity - 1);
+                _cells[j] = old[i];
+                _cells_used++;
+            }
+        delete[] old;
+    }
+
+    // Postings (i.e. lists of regions per cell)
+
+    void link(unsigned int & head, Id id) {
+        if(_free_posting == NONE)
+            grow_postings();
+        unsigned int p = _free_posting;
+        _free_posting = _next[p];
+        _postings[p] = id;
+        _next[p] = head;
+        head = p;
+    }
+
+    void unlink(unsigned int & head, Id id) {
+        for(unsigned int * p = &head; *p != NONE; p = &_next[*p])
+            if(_postings[*p] == id) {
+                unsigned int q = *p;
+                *p = _next[q];
+                _next[q] = _free_posting;
+                _free_posting = q;
+                return;
+            }
+    }
+
+    void grow_postings() {
+        unsigned int capacity = _postings_capacity ? 2 * _postings_capacity : 256;
+        resize(_postings, _postings_capacity, capacity);
+        resize(_next, _postings_capacity, capacity);
+        for(unsigned int i = capacity; i > _postings_capacity; i--) {
+            _next[i - 1] = _free_posting;
+            _free_posting = i - 1;
+        }
+        _postings_capacity = capacity;
+    }
+
+    // Regions (free ids are chained through _heap_position)
+
+    void grow_regions() {
+        unsigned int capacity = _regions_capacity ? 2 * _regions_capacity : 64;
+        resize(_regions, _regions_capacity, capacity);
+        resize(_live, _regions_capacity, capacity);
+        resize(_heap_position, _regions_capacity, capacity);
+        resize(_heap, _regions_capacity, capacity);
+        for(unsigned int i = capacity; i > _regions_capacity; i--) {
+            _live[i - 1] = false;
+            _heap_position[i - 1] = _free_region;
+            _free_region = i - 1;
+        }
+        _regions_capacity = capacity;
+    }
+
+    template<typename T>
+    static void resize(T * & a, unsigned int n, unsigned int capacity) {
+        T * b = new T[capacity];
+        for(unsigned int i = 0; i < n; i++)
+            b[i] = a[i];
+        delete[] a;
+        a = b;
+    }
+
+    // Heap of live regions by t1
+
+    long long end(Id id) const { return static_cast<long long>(_regions[id].t1); }
+
+    void up(unsigned int i) {
+        while(i && (end(_heap[i]) < end(_heap[(i - 1) / 2]))) {
+            swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void down(unsigned int i) {
+        for(;;) {
+            unsigned int l = 2 * i + 1, r = l + 1, m = i;
+            if((l < _size) && (end(_heap[l]) < end(_heap[m])))
+                m = l;
+            if((r < _size) && (end(_heap[r]) < end(_heap[m])))
+                m = r;
+            if(m == i)
+                return;
+            swap(i, m);
+            i = m;
+        }
+    }
+
+    void swap(unsigned int i, unsigned int j) {
+        Id t = _heap[i];
+        _heap[i] = _heap[j];
+        _heap[j] = t;
+        _heap_position[_heap[i]] = i;
+        _heap_position[_heap[j]] = j;
+    }
+
+private:
+    unsigned long long _cell;
+
+    Cell * _cells;
+    unsigned long long _cells_used;
+    unsigned long long _cells_capacity;
+
+    Id * _postings;
+    unsigned int * _next;
+    unsigned int _postings_capacity;
+    unsigned int _free_posting;
+
+    Region * _regions;
+    bool * _live;
+    unsigned int * _heap_position;
+    unsigned int _regions_capacity;
+    Id _free_region;
+
+    Id * _heap;
+    unsigned int _size;
+
+    unsigned int _large;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+// EPOS Slab Pool Utility Declarations
+
+// Pool of fixed-size, reference-counted blocks, meant for large payloads (e.g. camera frames) that are handed over to
+// several consumers: copying a Slab<SIZE>::Handle only bumps the block's reference count, and the block goes back to the
+// pool's free list when the last handle to it is released. Blocks are carved from chunks of BLOCKS blocks each, which
+// are never given back, so a steady stream of payloads reaches a point in which it does not allocate at all.
+
+template<unsigned int SIZE, unsigned int BLOCKS = 16>
+class Slab
+{
+private:
+    struct Block {
+        unsigned int refs;
+        Block * next;
+        alignas(16) unsigned char data[SIZE];
+    };
+
+public:
+    class Handle;
+
+public:
+    static Slab & pool() {
+        static Slab pool;
+        return pool;
+    }
+
+    // Number of blocks currently allocated from the pool (i.e. not in the free list)
+    unsigned int used() const { return __atomic_load_n(&_used, __ATOMIC_RELAXED); }
+
+private:
+    Slab(): _lock(false), _free(0), _used(0) {}
+
+    Block * alloc() {
+        lock();
+        if(!_free)
+            grow();
+        Block * b = _free;
+        _free = b->next;
+        unlock();
+        b->refs = 1;
+        __atomic_add_fetch(&_used, 1, __ATOMIC_RELAXED);
+        return b;
+    }
+
+    void free(Block * b) {
+        lock();
+        b->next = _free;
+        _free = b;
+        unlock();
+        __atomic_sub_fetch(&_used, 1, __ATOMIC_RELAXED);
+    }
+
+    void grow() {
+        Block * chunk = new Block[BLOCKS];
+        for(unsigned int i = 0; i < BLOCKS; i++) {
+            chunk[i].next = _free;
+            _free = &chunk[i];
+        }
+    }
+
+    void lock() { while(__atomic_test_and_set(&_lock, __ATOMIC_ACQUIRE)); }
+    void unlock() { __atomic_clear(&_lock, __ATOMIC_RELEASE); }
+
+private:
+    bool _lock;
+    Block * _free;
+    unsigned int _used;
+};
+
+// Reference to a block; null handles (e.g. default constructed ones) hold no block at all
+template<unsigned int SIZE, unsigned int BLOCKS>
+class Slab<SIZE, BLOCKS>::Handle
+{
+public:
+    Handle(): _block(0) {}
+    Handle(const Handle & h): _block(h._block) { acquire(); }
+    ~Handle() { release(); }
+
+    Handle & operator=(const Handle & h) {
+        Block * b = h._block;
+        if(b)
+            __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED); // before releasing, in case of self-assignment
+        release();
+        _block = b;
+        return *this;
+    }
+
+    // A fresh block (with undefined contents), for which this is the only handle
+    static Handle allocate() {
+        Handle h;
+        h._block = pool().alloc();
+        return h;
+    }
+
+    operator bool() const { return _block; }
+    bool unique() const { return _block && (__atomic_load_n(&_block->refs, __ATOMIC_ACQUIRE) == 1); }
+    unsigned int references() const { return _block ? __atomic_load_n(&_block->refs, __ATOMIC_RELAXED) : 0; }
+
+    const unsigned char * data() const { return _block ? _block->data : 0; }
+    unsigned char * data() { return _block ? _block->data : 0; }
+
+    // Makes sure this is the only handle to its block before the block is written, copying the contents if needed
+    unsigned char * writable() {
+        if(!unique()) {
+            Handle h = allocate();
+            if(_block)
+                __builtin_memcpy(h._block->data, _block->data, SIZE);
+            *this = h;
+        }
+        return _block->data;
+    }
+
+    void reset() {
+        release();
+        _block = 0;
+    }
+
+private:
+    void acquire() {
+        if(_block)
+            __atomic_add_fetch(&_block->refs, 1, __ATOMIC_RELAXED);
+    }
+
+    void release() {
+        if(_block && !__atomic_sub_fetch(&_block->refs, 1, __ATOMIC_ACQ_REL))
+            pool().free(_block);
+    }
+
+private:
+    Block * _block;
+};
@@ -0,0 +1,320 @@
+#pragma once
+
+// EPOS Statistics Utility Declarations
+
+// Single-pass reductions over arrays of Int32, Int64, Float32 or Float64: smallest, largest, sum, mean and variance at
+// once, instead of separate Math::smallest, largest, mean and variance passes. Sums are accumulated in double, shifted by
+// the first element, so the one-pass variance does not suffer from catastrophic cancellation.
+// On x86, the bulk of the array goes through SSE2 or AVX2 kernels (the latter selected at runtime), after a scalar head
+// that aligns the loads to the vector width (arrays of packed values, e.g. SmartData::Value, need not be aligned at all).
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define __STATISTICS_X86
+#endif
+
+namespace Math
+{
+template<typename T>
+struct Statistics
+{
+    T smallest;
+    T largest;
+    double sum;
+    double mean;
+    double variance; // of a sample (i.e. divided by n - 1), as Math::variance
+    unsigned long count;
+};
+
+namespace Reduction
+{
+// Partial results: extremes, plus the sum and the sum of squares of (v - k)
+template<typename T>
+struct Partial
+{
+    T smallest;
+    T largest;
+    double sum;
+    double squares;
+};
+
+template<typename T>
+inline void scalar(const T * a, unsigned long i, unsigned long n, double k, Partial<T> & p)
+{
+    for(; i < n; i++) {
+        T v = a[i];
+        p.smallest = (v < p.smallest) ? v : p.smallest;
+        p.largest = (v > p.largest) ? v : p.largest;
+        double d = static_cast<double>(v) - k;
+        p.sum += d;
+        p.squares += d * d;
+    }
+}
+
+// Folds the lanes of the vector kernels into a partial result
+template<typename T, unsigned int LANES, unsigned int SUMS>
+inline void fold(const T (& smallest)[LANES], const T (& largest)[LANES], const double (& sum)[SUMS], const double (& squares)[SUMS], Partial<T> & p)
+{
+    for(unsigned int i = 0; i < LANES; i++) {
+        p.smallest = (smallest[i] < p.smallest) ? smallest[i] : p.smallest;
+        p.largest = (largest[i] > p.largest) ? largest[i] : p.largest;
+    }
+    for(unsigned int i = 0; i < SUMS; i++) {
+        p.sum += sum[i];
+        p.squares += squares[i];
+    }
+}
+
+// Number of leading elements to handle in scalar code so the vector loads start at a multiple of ALIGNMENT
+template<typename T, unsigned int ALIGNMENT>
+inline unsigned long head(const T * a, unsigned long n)
+{
+    unsigned long misalignment = reinterpret_cast<unsigned long>(a) & (ALIGNMENT - 1);
+    if(!misalignment || (misalignment % sizeof(T)))
+        return 0; // either aligned already or never will be
+    unsigned long h = (ALIGNMENT - misalignment) / sizeof(T);
+    return (h < n) ? h : n;
+}
+
+#ifdef __STATISTICS_X86
+
+// Each kernel reduces a[i, n) down to a multiple of its width and returns where it stopped
+
+// SSE2
+inline unsigned long sse2(const float * a, unsigned long i, unsigned long n, double k, Partial<float> & p)
+{
+    __m128 mn = _mm_set1_ps(p.smallest), mx = _mm_set1_ps(p.largest);
+    __m128d kk = _mm_set1_pd(k), s0 = _mm_setzero_pd(), s1 = s0, q0 = s0, q1 = s0;
+    for(; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(&a[i]);
+        mn = _mm_min_ps(mn, v);
+        mx = _mm_max_ps(mx, v);
+        __m128d lo = _mm_sub_pd(_mm_cvtps_pd(v), kk);
+        __m128d hi = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), kk);
+        s0 = _mm_add_pd(s0, lo);
+        s1 = _mm_add_pd(s1, hi);
+        q0 = _mm_add_pd(q0, _mm_mul_pd(lo, lo));
+        q1 = _mm_add_pd(q1, _mm_mul_pd(hi, hi));
+    }
+    float smallest[4], largest[4];
+    double sum[2], squares[2];
+    _mm_storeu_ps(smallest, mn);
+    _mm_storeu_ps(largest, mx);
+    _mm_storeu_pd(sum, _mm_add_pd(s0, s1));
+    _mm_storeu_pd(squares, _mm_add_pd(q0, q1));
+    fold(smallest, largest, sum, squares, p);
+    return i;
+}
+
+inline unsigned long sse2(const double * a, unsigned long i, unsigned long n, double k, Partial<double> & p)
+{
+    __m128d mn = _mm_set1_pd(p.smallest), mx = _mm_set1_pd(p.largest);
+    __m128d kk = _mm_set1_pd(k), s0 = _mm_setzero_pd(), s1 = s0, q0 = s0, q1 = s0;
+    for(; i + 4 <= n; i += 4) {
+        __m128d v0 = _mm_loadu_pd(&a[i]);
+        __m128d v1 = _mm_loadu_pd(&a[i + 2]);
+        mn = _mm_min_pd(mn, _mm_min_pd(v0, v1));
+        mx = _mm_max_pd(mx, _mm_max_pd(v0, v1));
+        v0 = _mm_sub_pd(v0, kk);
+        v1 = _mm_sub_pd(v1, kk);
+        s0 = _mm_add_pd(s0, v0);
+        s1 = _mm_add_pd(s1, v1);
+        q0 = _mm_add_pd(q0, _mm_mul_pd(v0, v0));
+        q1 = _mm_add_pd(q1, _mm_mul_pd(v1, v1));
+    }
+    double smallest[2], largest[2], sum[2], squares[2];
+    _mm_storeu_pd(smallest, mn);
+    _mm_storeu_pd(largest, mx);
+    _mm_storeu_pd(sum, _mm_add_pd(s0, s1));
+    _mm_storeu_pd(squares, _mm_add_pd(q0, q1));
+    fold(smallest, largest, sum, squares, p);
+    return i;
+}
+
+inline unsigned long sse2(const int * a, unsigned long i, unsigned long n, double k, Partial<int> & p)
+{
+    // SSE2 has no pminsd/pmaxsd, so extremes are selected through comparison masks
+    __m128i mn = _mm_set1_epi32(p.smallest), mx = _mm_set1_epi32(p.largest);
+    __m128d kk = _mm_set1_pd(k), s0 = _mm_setzero_pd(), s1 = s0, q0 = s0, q1 = s0;
+    for(; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&a[i]));
+        __m128i lt = _mm_cmplt_epi32(v, mn);
+        __m128i gt = _mm_cmpgt_epi32(v, mx);
+        mn = _mm_or_si128(_mm_and_si128(lt, v), _mm_andnot_si128(lt, mn));
+        mx = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, mx));
+        __m128d lo = _mm_sub_pd(_mm_cvtepi32_pd(v), kk);
+        __m128d hi = _mm_sub_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))), kk);
+        s0 = _mm_add_pd(s0, lo);
+        s1 = _mm_add_pd(s1, hi);
+        q0 = _mm_add_pd(q0, _mm_mul_pd(lo, lo));
+        q1 = _mm_add_pd(q1, _mm_mul_pd(hi, hi));
+    }
+    int smallest[4], largest[4];
+    double sum[2], squares[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(smallest), mn);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(largest), mx);
+    _mm_storeu_pd(sum, _mm_add_pd(s0, s1));
+    _mm_storeu_pd(squares, _mm_add_pd(q0, q1));
+    fold(smallest, largest, sum, squares, p);
+    return i;
+}
+
+// SSE2 has neither 64-bit comparisons nor conversions to double, so Int64 arrays are left to the scalar loop
+template<typename T>
+inline unsigned long sse2(const T *, unsigned long i, unsigned long, double, Partial<T> &) { return i; }
+
+// AVX2
+__attribute__((target("avx2")))
+inline unsigned long avx2(const float * a, unsigned long i, unsigned long n, double k, Partial<float> & p)
+{
+    __m256 mn = _mm256_set1_ps(p.smallest), mx = _mm256_set1_ps(p.largest);
+    __m256d kk = _mm256_set1_pd(k), s0 = _mm256_setzero_pd(), s1 = s0, q0 = s0, q1 = s0;
+    for(; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(&a[i]);
+        mn = _mm256_min_ps(mn, v);
+        mx = _mm256_max_ps(mx, v);
+        __m256d lo = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), kk);
+        __m256d hi = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), kk);
+        s0 = _mm256_add_pd(s0, lo);
+        s1 = _mm256_add_pd(s1, hi);
+        q0 = _mm256_add_pd(q0, _mm256_mul_pd(lo, lo));
+        q1 = _mm256_add_pd(q1, _mm256_mul_pd(hi, hi));
+    }
+    float smallest[8], largest[8];
+    double sum[4], squares[4];
+    _mm256_storeu_ps(smallest, mn);
+    _mm256_storeu_ps(largest, mx);
+    _mm256_storeu_pd(sum, _mm256_add_pd(s0, s1));
+    _mm256_storeu_pd(squares, _mm256_add_pd(q0, q1));
+    fold(smallest, largest, sum, squares, p);
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline unsigned long avx2(const double * a, unsigned long i, unsigned long n, double k, Partial<double> & p)
+{
+    __m256d mn = _mm256_set1_pd(p.smallest), mx = _mm256_set1_pd(p.largest);
+    __m256d kk = _mm256_set1_pd(k), s0 = _mm256_setzero_pd(), s1 = s0, q0 = s0, q1 = s0;
+    for(; i + 8 <= n; i += 8) {
+        __m256d v0 = _mm256_loadu_pd(&a[i]);
+        __m256d v1 = _mm256_loadu_pd(&a[i + 4]);
+        mn = _mm256_min_pd(mn, _mm256_min_pd(v0, v1));
+        mx = _mm256_max_pd(mx, _mm256_max_pd(v0, v1));
+        v0 = _mm256_sub_pd(v0, kk);
+        v1 = _mm256_sub_pd(v1, kk);
+        s0 = _mm256_add_pd(s0, v0);
+        s1 = _mm256_add_pd(s1, v1);
+        q0 = _mm256_add_pd(q0, _mm256_mul_pd(v0, v0));
+        q1 = _mm256_add_pd(q1, _mm256_mul_pd(v1, v1));
+    }
+    double smallest[4], largest[4], sum[4], squares[4];
+    _mm256_storeu_pd(smallest, mn);
+    _mm256_storeu_pd(largest, mx);
+    _mm256_storeu_pd(sum, _mm256_add_pd(s0, s1));
+    _mm256_storeu_pd(squares, _mm256_add_pd(q0, q1));
+    fold(smallest, largest, sum, squares, p);
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline unsigned long avx2(const int * a, unsigned long i, unsigned long n, double k, Partial<int> & p)
+{
+    __m256i mn = _mm256_set1_epi32(p.smallest), mx = _mm256_set1_epi32(p.largest);
+    __m256d kk = _mm256_set1_pd(k), s0 = _mm256_setzero_pd(), s1 = s0, q0 = s0, q1 = s0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&a[i]));
+        mn = _mm256_min_epi32(mn, v);
+        mx = _mm256_max_epi32(mx, v);
+        __m256d lo = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), kk);
+        __m256d hi = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), kk);
+        s0 = _mm256_add_pd(s0, lo);
+        s1 = _mm256_add_pd(s1, hi);
+        q0 = _mm256_add_pd(q0, _mm256_mul_pd(lo, lo));
+        q1 = _mm256_add_pd(q1, _mm256_mul_pd(hi, hi));
+    }
+    int smallest[8], largest[8];
+    double sum[4], squares[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(smallest), mn);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(largest), mx);
+    _mm256_storeu_pd(sum, _mm256_add_pd(s0, s1));
+    _mm256_storeu_pd(squares, _mm256_add_pd(q0, q1));
+    fold(smallest, largest, sum, squares, p);
+    return i;
+}
+
+// 64-bit integers: extremes through 64-bit comparison masks; AVX2 still lacks conversions to double, so lanes are
+// converted one by one (the bulk of the work, the comparisons and the accumulation, stays vectorized)
+template<typename T>
+__attribute__((target("avx2")))
+inline unsigned long avx2_64(const T * a, unsigned long i, unsigned long n, double k, Partial<T> & p)
+{
+    __m256i mn = _mm256_set1_epi64x(p.smallest), mx = _mm256_set1_epi64x(p.largest);
+    __m256d kk = _mm256_set1_pd(k), s = _mm256_setzero_pd(), q = s;
+    for(; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&a[i]));
+        mn = _mm256_blendv_epi8(mn, v, _mm256_cmpgt_epi64(mn, v));
+        mx = _mm256_blendv_epi8(mx, v, _mm256_cmpgt_epi64(v, mx));
+        __m256d d = _mm256_sub_pd(_mm256_setr_pd(a[i], a[i + 1], a[i + 2], a[i + 3]), kk);
+        s = _mm256_add_pd(s, d);
+        q = _mm256_add_pd(q, _mm256_mul_pd(d, d));
+    }
+    T smallest[4], largest[4];
+    double sum[4], squares[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(smallest), mn);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(largest), mx);
+    _mm256_storeu_pd(sum, s);
+    _mm256_storeu_pd(squares, q);
+    fold(smallest, largest, sum, squares, p);
+    return i;
+}
+
+inline unsigned long avx2(const long * a, unsigned long i, unsigned long n, double k, Partial<long> & p) { return (sizeof(long) == 8) ? avx2_64(a, i, n, k, p) : i; }
+inline unsigned long avx2(const long long * a, unsigned long i, unsigned long n, double k, Partial<long long> & p) { return avx2_64(a, i, n, k, p); }
+
+inline bool has_avx2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+#endif
+}
+
+template<typename T>
+inline Statistics<T> statistics(const T array[], unsigned long size)
+{
+    Statistics<T> s = { T(0), T(0), 0, 0, 0, size };
+    if(!size)
+        return s;
+
+    double k = static_cast<double>(array[0]);
+    Reduction::Partial<T> p = { array[0], array[0], 0, 0 };
+    unsigned long i = 0;
+
+#ifdef __STATISTICS_X86
+#if defined(__AVX2__)
+    static const bool avx2 = true;
+#else
+    bool avx2 = Reduction::has_avx2();
+#endif
+    if(avx2) {
+        i = Reduction::head<T, 32>(array, size);
+        Reduction::scalar(array, 0, i, k, p);
+        i = Reduction::avx2(array, i, size, k, p);
+    } else {
+        i = Reduction::head<T, 16>(array, size);
+        Reduction::scalar(array, 0, i, k, p);
+        i = Reduction::sse2(array, i, size, k, p);
+    }
+#endif
+    Reduction::scalar(array, i, size, k, p);
+
+    s.smallest = p.smallest;
+    s.largest = p.largest;
+    s.sum = size * k + p.sum;
+    s.mean = k + p.sum / size;
+    s.variance = (size > 1) ? (p.squares - p.sum * p.sum / size) / (size - 1) : 0;
+    return s;
+}
+
+}
@@ -0,0 +1,413 @@
+#pragma once
+
+// EPOS Text Formatting Utility Declarations
+
+// Number to text conversions into caller-provided buffers, for high-throughput exports (e.g. of SmartData as CSV):
+// integers are written two digits at a time from a lookup table, and floating-point values in the shortest form that
+// reads back to the same value (Grisu2, which is shortest for all but a tiny fraction of values, and always round-trips).
+// All functions write at most the MAX bytes of their type, return the end of what they wrote, and do not terminate it.
+
+namespace Text
+{
+// Worst-case lengths
+static const unsigned int MAX_INTEGER = 20; // -9223372036854775808 or 18446744073709551615
+static const unsigned int MAX_FLOAT = 25;   // -2.2250738585072014e-308
+
+namespace Private
+{
+static const char DIGITS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+inline unsigned int digits(unsigned long long v)
+{
+    unsigned int n = 1;
+    for(;;) {
+        if(v < 10) return n;
+        if(v < 100) return n + 1;
+        if(v < 1000) return n + 2;
+        if(v < 10000) return n + 3;
+        v /= 10000;
+        n += 4;
+    }
+}
+
+// Writes the n digits of v backwards from p + n
+inline void put(char * p, unsigned long long v, unsigned int n)
+{
+    p += n;
+    while(v >= 100) {
+        unsigned int i = (v % 100) * 2;
+        v /= 100;
+        *--p = DIGITS[i + 1];
+        *--p = DIGITS[i];
+    }
+    if(v >= 10) {
+        *--p = DIGITS[v * 2 + 1];
+        *--p = DIGITS[v * 2];
+    } else
+        *--p = '0' + v;
+}
+
+// Floating point as f * 2^e (a "do-it-yourself floating point")
+struct Fp {
+    Fp(): f(0), e(0) {}
+    Fp(unsigned long long _f, int _e): f(_f), e(_e) {}
+
+    Fp operator-(const Fp & o) const { return Fp(f - o.f, e); }
+
+    // Upper 64 bits of the 128-bit product, rounded
+    Fp operator*(const Fp & o) const {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 p = static_cast<unsigned __int128>(f) * o.f;
+        return Fp((p >> 64) + ((p >> 63) & 1), e + o.e + 64);
+#else
+        const unsigned long long M32 = 0xffffffffULL;
+        unsigned long long a = f >> 32, b = f & M32, c = o.f >> 32, d = o.f & M32;
+        unsigned long long ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+        unsigned long long tmp = (bd >> 32) + (ad & M32) + (bc & M32) + (1ULL << 31);
+        return Fp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + o.e + 64);
+#endif
+    }
+
+    Fp normalize() const {
+        int s = __builtin_clzll(f);
+        return Fp(f << s, e - s);
+    }
+
+    unsigned long long f;
+    int e;
+};
+
+// Normalized 10^k for k = -348, -340, ..., 340, computed once (exactly, in binary long arithmetic) on first use
+class Powers
+{
+public:
+    static const int FIRST = -348;
+    static const int STEP = 8;
+    static const unsigned int COUNT = 87;
+
+public:
+    static const Fp & get(unsigned int i) {
+        static const Powers powers;
+        return powers._power[i];
+    }
+
+private:
+    static const unsigned int WORDS = 40; // 10^348 < 2^1160
+
+    struct Big {
+        Big(unsigned int v): n(1) { w[0] = v; }
+
+        void mul(unsigned int m) {
+            unsigned long long carry = 0;
+            for(unsigned int i = 0; i < n; i++) {
+                carry += static_cast<unsigned long long>(w[i]) * m;
+                w[i] = carry;
+                carry >>= 32;
+            }
+            if(carry)
+                w[n++] = carry;
+        }
+
+        int bits() const { return n * 32 - __builtin_clz(w[n - 1]); }
+        bool bit(int i) const { return (i >= 0) && ((w[i / 32] >> (i % 32)) & 1); }
+        bool any(int below) const {
+            for(int i = 0; i < below; i++)
+                if(bit(i)) return true;
+            return false;
+        }
+
+        unsigned int w[WORDS + 1];
+        unsigned int n;
+    };
+
+    // Largest 64 bits of a number given bit by bit from the top, rounded to nearest
+    static Fp round(unsigned long long top, bool half, bool rest, int e) {
+        if(half && (rest || (top & 1)))
+            if(!++top) {
+                top = 1ULL << 63;
+                e++;
+            }
+        return Fp(top, e);
+    }
+
+    Powers() {
+        for(unsigned int i = 0; i < COUNT; i++) {
+            int k = FIRST + int(i) * STEP;
+            Big p(1);
+            for(int j = 0; j < (k < 0 ? -k : k); j++)
+                p.mul(10);
+            int l = p.bits();
+            if(k >= 0) {
+                unsigned long long top = 0;
+                for(int b = l - 1; b >= l - 64; b--)
+                    top = (top << 1) | p.bit(b);
+                _power[i] = round(top, p.bit(l - 65), p.any(l - 65), l - 64);
+            } else
+                _power[i] = reciprocal(p, l);
+        }
+    }
+
+    // 1 / d, by binary long division of 2^s by d, for an s that gives more than 65 quotient bits
+    static Fp reciprocal(const Big & d, int l) {
+        Big r(0);
+        r.n = d.n + 1;
+        for(unsigned int i = 0; i < r.n; i++)
+            r.w[i] = 0;
+        int s = l + 66;
+        unsigned long long top = 0;
+        int got = 0; // significant quotient bits so far
+        int e = 0;
+        bool half = false, rest = false;
+        for(int b = s; b >= 0; b--) {
+            unsigned int carry = (b == s); // r = 2r + the dividend's bit
+            for(unsigned int i = 0; i < r.n; i++) {
+                unsigned int c = r.w[i] >> 31;
+                r.w[i] = (r.w[i] << 1) | carry;
+                carry = c;
+            }
+            bool ge = true;
+            for(int i = r.n - 1; i >= 0; i--) {
+                unsigned int dw = (static_cast<unsigned int>(i) < d.n) ? d.w[i] : 0;
+                if(r.w[i] != dw) {
+                    ge = r.w[i] > dw;
+                    break;
+                }
+            }
+            if(ge) { // r -= d
+                unsigned long long borrow = 0;
+                for(unsigned int i = 0; i < r.n; i++) {
+                    unsigned long long t = static_cast<unsigned long long>(r.w[i]) - ((i < d.n) ? d.w[i] : 0) - borrow;
+                    r.w[i] = t;
+                    borrow = (t >> 32) & 1;
+                }
+            }
+            if(got || ge) {
+                if(got < 64) {
+                    top = (top << 1) | ge;
+                    if(++got == 64)
+                        e = b - s;
+                } else if(got++ == 64)
+                    half = ge;
+                else
+                    rest = rest || ge;
+            }
+        }
+        for(unsigned int i = 0; i < r.n; i++)
+            rest = rest || r.w[i];
+        return round(top, half, rest, e);
+    }
+
+private:
+    Fp _power[COUNT];
+};
+
+// Decomposition of IEEE 754 binary32 and binary64 values
+template<typename T>
+struct IEEE754;
+
+template<>
+struct IEEE754<float> {
+    typedef unsigned int Bits;
+    static const int SIGNIFICAND = 23;
+    static const int BIAS = 127 + SIGNIFICAND;
+    static const int EXPONENT = 0xff;
+};
+
+template<>
+struct IEEE754<double> {
+    typedef unsigned long long Bits;
+    static const int SIGNIFICAND = 52;
+    static const int BIAS = 1023 + SIGNIFICAND;
+    static const int EXPONENT = 0x7ff;
+};
+
+inline void round(char * digits, unsigned int n, unsigned long long delta, unsigned long long rest, unsigned long long ten_kappa, unsigned long long wp_w)
+{
+    while((rest < wp_w) && (delta - rest >= ten_kappa) && ((rest + ten_kappa < wp_w) || (wp_w - rest > rest + ten_kappa - wp_w))) {
+        digits[n - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+// Shortest digits of w within (m-, m+) (scaled by a cached power), with k adjusted to the decimal exponent of the last digit
+inline unsigned int generate(char * digits, const Fp & w, const Fp & mp, unsigned long long delta, int & k)
+{
+    static const unsigned int POW10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+    const Fp one(1ULL << -mp.e, mp.e);
+    const Fp wp_w = mp - w;
+    unsigned int p1 = mp.f >> -one.e;
+    unsigned long long p2 = mp.f & (one.f - 1);
+    int kappa = Private::digits(p1);
+    unsigned int n = 0;
+
+    while(kappa > 0) {
+        unsigned int d;
+        switch(kappa) { // constant divisors, so no divisions are actually done
+        case 10: d = p1 / 1000000000; p1 %= 1000000000; break;
+        case  9: d = p1 /  100000000; p1 %=  100000000; break;
+        case  8: d = p1 /   10000000; p1 %=   10000000; break;
+        case  7: d = p1 /    1000000; p1 %=    1000000; break;
+        case  6: d = p1 /     100000; p1 %=     100000; break;
+        case  5: d = p1 /      10000; p1 %=      10000; break;
+        case  4: d = p1 /       1000; p1 %=       1000; break;
+        case  3: d = p1 /        100; p1 %=        100; break;
+        case  2: d = p1 /         10; p1 %=         10; break;
+        default: d = p1;              p1 =           0;
+        }
+        if(d || n)
+            digits[n++] = '0' + d;
+        kappa--;
+        unsigned long long tmp = (static_cast<unsigned long long>(p1) << -one.e) + p2;
+        if(tmp <= delta) {
+            k += kappa;
+            round(digits, n, delta, tmp, static_cast<unsigned long long>(POW10[kappa]) << -one.e, wp_w.f);
+            return n;
+        }
+    }
+    for(;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = p2 >> -one.e;
+        if(d || n)
+            digits[n++] = '0' + d;
+        p2 &= one.f - 1;
+        kappa--;
+        if(p2 < delta) {
+            k += kappa;
+            round(digits, n, delta, p2, one.f, (-kappa < 10) ? wp_w.f * POW10[-kappa] : 0);
+            return n;
+        }
+    }
+}
+
+// Grisu2 on a finite, positive v: its digits, with v = digits * 10^k
+template<typename T>
+inline unsigned int grisu2(char * digits, T v, int & k)
+{
+    typedef IEEE754<T> F;
+    typename F::Bits bits;
+    __builtin_memcpy(&bits, &v, sizeof(T));
+    const unsigned long long hidden = 1ULL << F::SIGNIFICAND;
+    unsigned long long significand = bits & (hidden - 1);
+    int exponent = (bits >> F::SIGNIFICAND) & F::EXPONENT;
+    Fp f = exponent ? Fp(significand + hidden, exponent - F::BIAS) : Fp(significand, 1 - F::BIAS);
+
+    // Boundaries m- and m+ (halfway to the neighbouring values), normalized to the same exponent
+    Fp mp = Fp((f.f << 1) + 1, f.e - 1).normalize();
+    Fp mm = (f.f == hidden) ? Fp((f.f << 2) - 1, f.e - 2) : Fp((f.f << 1) - 1, f.e - 1);
+    mm.f <<= mm.e - mp.e;
+    mm.e = mp.e;
+
+    // Cached power c = 10^-k that brings the exponent of mp * c into [-60, -32]
+    int ik = -((-(-61 - mp.e) * 78913) >> 18) + 347; // ceil((-61 - e) * log10(2)) + 347 (78913 / 2^18 ~ log10(2))
+    unsigned int i = (ik >> 3) + 1;
+    k = -(Powers::FIRST + static_cast<int>(i) * Powers::STEP);
+    const Fp & c = Powers::get(i);
+
+    Fp w = f.normalize() * c;
+    Fp wp = mp * c;
+    Fp wm = mm * c;
+    wm.f++;
+    wp.f--;
+    return generate(digits, w, wp, wp.f - wm.f, k);
+}
+
+// Lays out digits * 10^k as in JavaScript (e.g. 1500, 0.0015, 1.5e+21, 1.5e-7), without a trailing ".0" for integers
+inline char * layout(char * p, char * digits, unsigned int n, int k)
+{
+    int kk = n + k; // 10^(kk - 1) <= v < 10^kk
+    if((k >= 0) && (kk <= 21)) {
+        for(unsigned int i = 0; i < n; i++)
+            *p++ = digits[i];
+        for(int i = 0; i < k; i++)
+            *p++ = '0';
+    } else if((kk > 0) && (kk <= 21)) {
+        for(int i = 0; i < kk; i++)
+            *p++ = digits[i];
+        *p++ = '.';
+        for(unsigned int i = kk; i < n; i++)
+            *p++ = digits[i];
+    } else if((kk > -6) && (kk <= 0)) {
+        *p++ = '0';
+        *p++ = '.';
+        for(int i = kk; i < 0; i++)
+            *p++ = '0';
+        for(unsigned int i = 0; i < n; i++)
+            *p++ = digits[i];
+    } else {
+        *p++ = digits[0];
+        if(n > 1) {
+            *p++ = '.';
+            for(unsigned int i = 1; i < n; i++)
+                *p++ = digits[i];
+        }
+        *p++ = 'e';
+        int e = kk - 1;
+        if(e < 0) {
+            *p++ = '-';
+            e = -e;
+        } else
+            *p++ = '+';
+        unsigned int m = Private::digits(e);
+        Private::put(p, e, m);
+        p += m;
+    }
+    return p;
+}
+
+template<typename T>
+inline char * format_float(char * p, T v)
+{
+    if(v != v) {
+        __builtin_memcpy(p, "nan", 3);
+        return p + 3;
+    }
+    if(__builtin_signbit(v)) {
+        *p++ = '-';
+        v = -v;
+    }
+    if(v == 0) {
+        *p++ = '0';
+        return p;
+    }
+    if(v > __builtin_huge_val() || (v == static_cast<T>(__builtin_huge_val()))) {
+        __builtin_memcpy(p, "inf", 3);
+        return p + 3;
+    }
+    char digits[20];
+    int k;
+    unsigned int n = grisu2(digits, v, k);
+    return layout(p, digits, n, k);
+}
+
+}
+
+inline char * format(char * p, unsigned long long v)
+{
+    unsigned int n = Private::digits(v);
+    Private::put(p, v, n);
+    return p + n;
+}
+
+inline char * format(char * p, long long v)
+{
+    unsigned long long u = v;
+    if(v < 0) {
+        *p++ = '-';
+        u = 0 - u;
+    }
+    return format(p, u);
+}
+
+inline char * format(char * p, unsigned int v) { return format(p, static_cast<unsigned long long>(v)); }
+inline char * format(char * p, int v) { return format(p, static_cast<long long>(v)); }
+inline char * format(char * p, unsigned long v) { return format(p, static_cast<unsigned long long>(v)); }
+inline char * format(char * p, long v) { return format(p, static_cast<long long>(v)); }
+
+// Shortest round-trip representation, or nan, inf or -inf
+inline char * format(char * p, float v) { return Private::format_float(p, v); }
+inline char * format(char * p, double v) { return Private::format_float(p, v); }
+
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+// EPOS Variable-Length Integer Utility Declarations
+
+// LEB128 varints with zig-zag mapping for signed values, plus the delta (integers) and XOR (floating point, Gorilla-like,
+// but byte-aligned so decoding needs no bit-level shifting) encodings used to compress slowly changing time series.
+// All functions advance the buffer pointer they are given. Readers also take the end of the buffer and return false,
+// with the pointer somewhere before it, on truncated or malformed input.
+
+namespace Varint
+{
+// Worst-case number of bytes taken by a varint of an N-byte value
+template<unsigned int N>
+struct MAX { enum { Result = (N * 8 + 6) / 7 }; };
+
+inline unsigned long long zigzag(long long v) { return (static_cast<unsigned long long>(v) << 1) ^ static_cast<unsigned long long>(v >> 63); }
+inline long long unzigzag(unsigned long long v) { return static_cast<long long>(v >> 1) ^ -static_cast<long long>(v & 1); }
+
+inline void put(unsigned char * & p, unsigned long long v)
+{
+    while(v >= 0x80) {
+        *p++ = static_cast<unsigned char>(v) | 0x80;
+        v >>= 7;
+    }
+    *p++ = static_cast<unsigned char>(v);
+}
+
+inline bool get(const unsigned char * & p, const unsigned char * end, unsigned long long & v)
+{
+    if(p >= end)
+        return false;
+    v = *p++;
+    if(v < 0x80)
+        return true;
+    v &= 0x7f;
+    for(unsigned int shift = 7; shift < 64; shift += 7) {
+        if(p >= end)
+            return false;
+        unsigned long long b = *p++;
+        if((shift == 63) && (b > 1))
+            return false; // bits beyond 64 (or more than MAX<8> bytes)
+        v |= (b & 0x7f) << shift;
+        if(b < 0x80)
+            return true;
+    }
+    return false;
+}
+
+// Delta encoding: zig-zag varint of the difference to the previous value (computed in the unsigned domain, so it wraps)
+inline void put_delta(unsigned char * & p, int v, int last) { put(p, zigzag(static_cast<int>(static_cast<unsigned int>(v) - static_cast<unsigned int>(last)))); }
+inline void put_delta(unsigned char * & p, long v, long last) { put(p, zigzag(static_cast<long>(static_cast<unsigned long>(v) - static_cast<unsigned long>(last)))); }
+inline void put_delta(unsigned char * & p, long long v, long long last) { put(p, zigzag(static_cast<long long>(static_cast<unsigned long long>(v) - static_cast<unsigned long long>(last)))); }
+
+inline bool get_delta(const unsigned char * & p, const unsigned char * end, int & v)
+{
+    unsigned long long d;
+    if(!get(p, end, d))
+        return false;
+    v = static_cast<int>(static_cast<unsigned int>(v) + static_cast<unsigned int>(unzigzag(d)));
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, const unsigned char * end, long & v)
+{
+    unsigned long long d;
+    if(!get(p, end, d))
+        return false;
+    v = static_cast<long>(static_cast<unsigned long>(v) + static_cast<unsigned long>(unzigzag(d)));
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, const unsigned char * end, long long & v)
+{
+    unsigned long long d;
+    if(!get(p, end, d))
+        return false;
+    v = static_cast<long long>(static_cast<unsigned long long>(v) + static_cast<unsigned long long>(unzigzag(d)));
+    return true;
+}
+
+// XOR encoding: a control byte (0 if unchanged, else 0x40 | leading zero bytes << 3 | trailing zero bytes) followed by
+// the meaningful bytes of the XOR with the previous value
+template<typename Word>
+inline void put_xor(unsigned char * & p, Word x)
+{
+    if(!x) {
+        *p++ = 0;
+        return;
+    }
+    unsigned int lead = (sizeof(Word) == 8 ? __builtin_clzll(x) : __builtin_clz(x)) / 8;
+    unsigned int trail = (sizeof(Word) == 8 ? __builtin_ctzll(x) : __builtin_ctz(x)) / 8;
+    *p++ = 0x40 | (lead << 3) | trail;
+    x >>= trail * 8;
+    for(unsigned int i = 0; i < sizeof(Word) - lead - trail; i++, x >>= 8)
+        *p++ = static_cast<unsigned char>(x);
+}
+
+template<typename Word>
+inline bool get_xor(const unsigned char * & p, const unsigned char * end, Word & x)
+{
+    if(p >= end)
+        return false;
+    unsigned char c = *p++;
+    x = 0;
+    if(!c)
+        return true;
+    unsigned int lead = (c >> 3) & 7;
+    unsigned int trail = c & 7;
+    if(((c & 0xc0) != 0x40) || (lead + trail >= sizeof(Word)))
+        return false;
+    unsigned int n = sizeof(Word) - lead - trail;
+    if(static_cast<unsigned long>(end - p) < n)
+        return false;
+    for(unsigned int i = 0; i < n; i++)
+        x |= static_cast<Word>(*p++) << (i * 8);
+    x <<= trail * 8;
+    return true;
+}
+
+inline void put_delta(unsigned char * & p, float v, float last)
+{
+    unsigned int a, b;
+    __builtin_memcpy(&a, &v, sizeof(float));
+    __builtin_memcpy(&b, &last, sizeof(float));
+    put_xor(p, a ^ b);
+}
+
+inline void put_delta(unsigned char * & p, double v, double last)
+{
+    unsigned long long a, b;
+    __builtin_memcpy(&a, &v, sizeof(double));
+    __builtin_memcpy(&b, &last, sizeof(double));
+    put_xor(p, a ^ b);
+}
+
+inline bool get_delta(const unsigned char * & p, const unsigned char * end, float & v)
+{
+    unsigned int a, x;
+    if(!get_xor(p, end, x))
+        return false;
+    __builtin_memcpy(&a, &v, sizeof(float));
+    a ^= x;
+    __builtin_memcpy(&v, &a, sizeof(float));
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, const unsigned char * end, double & v)
+{
+    unsigned long long a, x;
+    if(!get_xor(p, end, x))
+        return false;
+    __builtin_memcpy(&a, &v, sizeof(double));
+    a ^= x;
+    __builtin_memcpy(&v, &a, sizeof(double));
+    return true;
+}
+
+// Unchecked readers, for callers that already know that at least MAX<sizeof(v)> bytes remain (e.g. because a whole
+// worst-case sample does): they never read more than that, so the end of the buffer is tested once per sample instead
+// of once per byte, and still return false on malformed input
+// Bytes after the first of a varint, with its low 7 bits already in v; the next byte to read, or null on malformed input.
+// Kept out of line, so the common one-byte case of get<N>() inlines into sample decoders.
+template<unsigned int N>
+const unsigned char * tail(const unsigned char * p, unsigned long long & v) __attribute__((noinline));
+
+template<unsigned int N>
+const unsigned char * tail(const unsigned char * p, unsigned long long & v)
+{
+    v &= 0x7f;
+    for(unsigned int shift = 7; shift < MAX<N>::Result * 7; shift += 7) {
+        unsigned long long b = *p++;
+        if((shift == 63) && (b > 1))
+            return 0;
+        v |= (b & 0x7f) << shift;
+        if(b < 0x80)
+            return p;
+    }
+    return 0;
+}
+
+template<unsigned int N>
+inline bool get(const unsigned char * & p, unsigned long long & v) __attribute__((always_inline));
+
+template<unsigned int N>
+inline bool get(const unsigned char * & p, unsigned long long & v)
+{
+    v = *p++;
+    if(v < 0x80)
+        return true;
+    const unsigned char * q = tail<N>(p, v);
+    if(!q)
+        return false;
+    p = q;
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, int & v) __attribute__((always_inline));
+inline bool get_delta(const unsigned char * & p, int & v)
+{
+    unsigned long long d;
+    if(!get<sizeof(int)>(p, d))
+        return false;
+    v = static_cast<int>(static_cast<unsigned int>(v) + static_cast<unsigned int>(unzigzag(d)));
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, long & v) __attribute__((always_inline));
+inline bool get_delta(const unsigned char * & p, long & v)
+{
+    unsigned long long d;
+    if(!get<sizeof(long)>(p, d))
+        return false;
+    v = static_cast<long>(static_cast<unsigned long>(v) + static_cast<unsigned long>(unzigzag(d)));
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, long long & v) __attribute__((always_inline));
+inline bool get_delta(const unsigned char * & p, long long & v)
+{
+    unsigned long long d;
+    if(!get<sizeof(long long)>(p, d))
+        return false;
+    v = static_cast<long long>(static_cast<unsigned long long>(v) + static_cast<unsigned long long>(unzigzag(d)));
+    return true;
+}
+
+// Takes 1 + sizeof(Word) bytes at most, which is no more than MAX<sizeof(Word)>
+template<typename Word>
+inline bool get_xor(const unsigned char * & p, Word & x)
+{
+    unsigned char c = *p++;
+    x = 0;
+    if(!c)
+        return true;
+    unsigned int lead = (c >> 3) & 7;
+    unsigned int trail = c & 7;
+    if(((c & 0xc0) != 0x40) || (lead + trail >= sizeof(Word)))
+        return false;
+    unsigned int n = sizeof(Word) - lead - trail;
+    for(unsigned int i = 0; i < n; i++)
+        x |= static_cast<Word>(*p++) << (i * 8);
+    x <<= trail * 8;
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, float & v) __attribute__((always_inline));
+inline bool get_delta(const unsigned char * & p, float & v)
+{
+    unsigned int a, x;
+    if(!get_xor(p, x))
+        return false;
+    __builtin_memcpy(&a, &v, sizeof(float));
+    a ^= x;
+    __builtin_memcpy(&v, &a, sizeof(float));
+    return true;
+}
+
+inline bool get_delta(const unsigned char * & p, double & v) __attribute__((always_inline));
+inline bool get_delta(const unsigned char * & p, double & v)
+{
+    unsigned long long a, x;
+    if(!get_xor(p, x))
+        return false;
+    __builtin_memcpy(&a, &v, sizeof(double));
+    a ^= x;
+    __builtin_memcpy(&v, &a, sizeof(double));
+    return true;
+}
+}